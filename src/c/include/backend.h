@@ -0,0 +1,86 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "term_shapes.h"
+
+/* attributes that cells and text are drawn with */
+enum backend_attr {
+	ATTR_NORMAL,
+	ATTR_BOLD,
+	ATTR_DIM
+};
+
+/*
+ * where presented frames go and where input comes from. The ncurses backend
+ * draws to the terminal, while the headless backends draw into an in-memory
+ * screen and read input from stdin, so the whole pipeline can run without a
+ * TTY
+ */
+struct backend {
+	const char *name;
+	int interactive; /* whether the backend owns a terminal for prompts */
+
+	/*
+	 * whether the bytes put and flush return are guessed from what was
+	 * asked for, rather than counted as they were written
+	 */
+	int estimated;
+
+	int (*init)(struct backend *b);
+	void (*end)(struct backend *b);
+
+	/* size of the screen in cells */
+	void (*size)(struct backend *b, int *rows, int *cols);
+
+	/*
+	 * writes len bytes of the UTF-8 string str starting at row, col, one
+	 * character per cell, and returns the number of bytes of output that
+	 * took, if it's known before the flush
+	 */
+	long (*put)(struct backend *b, int row, int col,
+		    const char *str, int len, enum backend_attr attr);
+
+	/*
+	 * makes everything put since the last flush visible, and returns the
+	 * number of bytes of output that took on top of what put returned
+	 */
+	long (*flush)(struct backend *b);
+
+	/* blocks for the next key of input, returns 'q' at the end of input */
+	int (*read_key)(struct backend *b);
+
+	/*
+	 * next key of input if there's one waiting, else BACKEND_NO_KEY.
+	 * Interactive backends read from stdin so the loop can poll it, and
+	 * only they have this
+	 */
+	int (*poll_key)(struct backend *b);
+
+	/* screen of the headless backends */
+	int rows;
+	int cols;
+	char *grid; /* BACKEND_CELL bytes per cell, NUL padded */
+	int frame;
+};
+
+/* returned by poll_key when no input is waiting */
+#define BACKEND_NO_KEY -1
+
+/* returned by read_key and poll_key when the screen changed size */
+#define BACKEND_RESIZE -2
+
+#define BACKEND_ROWS 24
+#define BACKEND_COLS 80
+
+/* bytes of a cell of the in-memory screen, enough for any UTF-8 character */
+#define BACKEND_CELL 4
+
+/* prototypes */
+struct backend *backend_find(const char *name);
+struct backend *backend_default(void);
+void backend_set_size(struct backend *b, int rows, int cols);
+#if USE_NCURSES
+struct backend *backend_ncurses(void);
+#endif
+
+#endif /* BACKEND_H */
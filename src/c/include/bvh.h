@@ -0,0 +1,22 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "vector.h"
+#include "term_shapes.h"
+
+/* most faces in a leaf of the hierarchy */
+#define BVH_LEAF_SIZE 4
+
+/*
+ * depth of the traversal stack. The tree is balanced, so this covers far more
+ * faces than MAX_FACES
+ */
+#define BVH_STACK 64
+
+/* prototypes */
+int build_bvh(struct shape *s);
+void refit_bvh(struct shape *s);
+int bvh_segment(struct shape *s, point3 *p0, point3 *p1,
+		int (*hit)(struct shape *, int, int, void *), void *arg);
+
+#endif /* BVH_H */
@@ -4,7 +4,19 @@
 #include "vector.h"
 #include "term_shapes.h"
 
+/*
+ * how far in front of the plane of a face a vertex can be, relative to the
+ * size of the shape, and still count as on it, since the coordinates in shape
+ * files are rounded
+ */
+#define CONVEX_EPSILON 1e-4
+
 /* prototypes */
-int occlude_point_convex(struct shape *s, point3 *point, struct edge *edge);
+uint64_t occlude_block_convex(struct shape *s, struct point_block *b,
+			      struct edge *edge);
+void orient_faces(struct shape *s);
+int check_convex(struct shape *s);
+void project_faces(struct shape *s);
+void classify_edges(struct shape *s);
 
 #endif /* CONVEX_OCCLUSION_H */
@@ -0,0 +1,130 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+
+#include "term_shapes.h"
+
+/*
+ * a cell is split into a grid of dots, either 1x2 (the upper and lower half of
+ * a "terminal pixel") or 2x4 (a braille character). Dots are numbered in the
+ * bit order of the Unicode braille patterns, so in braille mode the dots of a
+ * cell are its character:
+ *
+ *	0x01 0x08
+ *	0x02 0x10
+ *	0x04 0x20
+ *	0x40 0x80
+ *
+ * in half block mode the upper half of a cell covers the top two rows of dots
+ * and the lower half the bottom two.
+ *
+ * points detected as in front are kept in the low byte of a cell and points
+ * detected as behind in the high byte, so merging points is a bitwise or
+ */
+#define FB_UPPER 0x1b
+#define FB_LOWER 0xe4
+
+#define FB_FRONT  0x00ff
+#define FB_BEHIND 0xff00
+
+/*
+ * value in prev for a position whose contents on the screen aren't known (it
+ * was written over by text or the screen was cleared), so it's always redrawn
+ */
+#define FB_UNKNOWN 0xffffffff
+
+/* most bytes a cell can take to print (a braille character in UTF-8) */
+#define FB_GLYPH_MAX 3
+
+/* what the last present wrote to the screen */
+struct fb_stats {
+	int cells; /* number of cells that changed */
+	int spans; /* number of runs of cells written */
+
+	/*
+	 * bytes of output written to the screen. For the terminal these are
+	 * the bytes curses wrote to it, unless the system can't count them
+	 * (see backend_ncurses.c)
+	 */
+	long bytes;
+};
+
+/*
+ * one packed cell per terminal position, sized to the screen
+ *
+ * cells is the frame being drawn and prev is what was presented on the screen
+ * for the frame before it, so only the cells that differ need to be written.
+ * shade is the character of the filled face under each cell (0 for none),
+ * which shows where no edge was drawn. text is the character of text printed
+ * over each cell, like the status text and vertex labels (0 for none), which
+ * shows over everything else. prev holds the dots of a presented cell, or the
+ * shade character shifted above them, or the text character shifted above
+ * that, so text is diffed like the rest of the frame
+ */
+struct framebuffer {
+	int rows;
+	int cols;
+	uint16_t *cells;
+	uint8_t *shade;
+	uint8_t *text;
+	uint32_t *prev;
+	char *line; /* one row of characters being presented, in UTF-8 */
+
+	struct fb_stats stats;
+};
+
+/* number of dots across and down a cell */
+static inline
+int
+fb_dots_x(enum pixel_mode mode)
+{
+	return mode == BRAILLE ? 2 : 1;
+}
+
+static inline
+int
+fb_dots_y(enum pixel_mode mode)
+{
+	return mode == BRAILLE ? 4 : 2;
+}
+
+/*
+ * bit of the front dots a point occupies, given its dot column x and dot row y
+ * inside of the cell
+ */
+static inline
+uint16_t
+fb_dot(enum pixel_mode mode, int x, int y)
+{
+	static const uint8_t braille[4][2] = {
+		{0x01, 0x08},
+		{0x02, 0x10},
+		{0x04, 0x20},
+		{0x40, 0x80}
+	};
+
+	if (mode == BRAILLE) {
+		return braille[y][x];
+	}
+
+	return y ? FB_LOWER : FB_UPPER;
+}
+
+static inline
+uint16_t *
+fb_cell(struct framebuffer *fb, int row, int col)
+{
+	return &(fb->cells[row * fb->cols + col]);
+}
+
+/* prototypes */
+struct framebuffer *fb_create(void);
+int fb_resize(struct framebuffer *fb, int rows, int cols);
+void fb_clear(struct framebuffer *fb);
+void fb_invalidate(struct framebuffer *fb);
+void fb_invalidate_span(struct framebuffer *fb, int row, int col, int len);
+void fb_destroy(struct framebuffer *fb);
+int fb_glyph(uint8_t dots, enum pixel_mode mode, char *out);
+
+#endif /* FRAMEBUFFER_H */
@@ -0,0 +1,36 @@
+#ifndef HALF_EDGE_H
+#define HALF_EDGE_H
+
+#include "term_shapes.h"
+
+/*
+ * whether the edge is one of the edges of face f. An edge on more than two
+ * faces only has one of them in edge->face, so for those the half edges of
+ * the face are searched for it
+ */
+static inline
+int
+edge_on_face(struct shape *s, struct edge *edge, int f)
+{
+	int k, he;
+
+	if (f == edge->face[0] || f == edge->face[1]) {
+		return 1;
+	} else if (edge->num_faces <= 2) {
+		return 0;
+	}
+
+	he = s->faces[f].he;
+	for (k = 0; k < s->faces[f].num_v; ++k) {
+		if (s->half_edges[he + k].edge == edge - s->edges) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* prototypes */
+int build_half_edges(struct shape *s);
+
+#endif /* HALF_EDGE_H */
@@ -0,0 +1,172 @@
+#ifndef HIDDEN_LINE_H
+#define HIDDEN_LINE_H
+
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * how far in front of a point a face has to be to hide it, so the points of
+ * an edge aren't hidden by the faces that meet at its vertices
+ */
+#define HL_EPSILON 1e-9
+
+/* width and height of the screen tiles faces are binned in, in cells */
+#define HL_TILE 8
+
+/*
+ * with fewer faces than this, walking the tiles under an edge costs more than
+ * it saves, so the whole screen is one tile
+ */
+#define HL_TILE_MIN_FACES 128
+
+/*
+ * range of the parameter along an edge, which is 0 at its first vertex and 1
+ * at its second
+ */
+struct interval {
+	double start;
+	double end;
+};
+
+/* bounding box on the screen in dots, empty if min_x > max_x */
+struct hl_box {
+	double min_x;
+	double max_x;
+	double min_y;
+	double max_y;
+};
+
+/* where a face is on the screen, found once a frame */
+struct hl_face {
+	int flat;     /* the face is seen edge on and hides nothing */
+	int ccw;      /* the face goes counterclockwise on the screen */
+	double max_z; /* depth of the closest vertex */
+	double z0;    /* depth = z0 + x * dzdx + y * dzdy */
+	double dzdx;
+	double dzdy;
+};
+
+/*
+ * things binned by the tiles of the screen their bounding box overlaps. The
+ * things in tile i are items[start[i]] up to items[start[i + 1]], and tiles go
+ * across then down
+ */
+struct tile_bins {
+	int *start;
+	int max_start;
+	int *items;
+	int max_items;
+};
+
+/*
+ * space to find the hidden intervals of an edge in. Each thread has its own,
+ * so threads can find them for different edges at once
+ */
+struct hl_scratch {
+	/* hidden intervals of the last edge, sorted and not overlapping */
+	struct interval *hidden;
+	int num_hidden;
+	int max_hidden;
+
+	double *t; /* where an edge is cut */
+	int max_t;
+
+	/*
+	 * faces and silhouettes already tested against the current edge are
+	 * marked with stamp
+	 */
+	int *seen;
+	int max_seen;
+	int *sil_seen;
+	int max_sil_seen;
+	int stamp;
+};
+
+/*
+ * state for ANALYTIC occlusion, where every edge is intersected with the
+ * projections of the faces to find exactly which parts of it are hidden
+ */
+struct hidden_line {
+	struct hl_face *faces;
+	struct hl_box *face_box;
+	int max_faces;
+
+	/* scratch of each thread, one for every thread of the shape */
+	struct hl_scratch *scratch;
+	int num_scratch;
+
+	/* screen tiles, rebuilt every frame */
+	int tile_w; /* size of a tile in dots */
+	int tile_h;
+	int tiles_x;
+	int tiles_y;
+	struct tile_bins face_bins;
+
+	/*
+	 * 1 if no face of the shape crosses itself, so edges are only hidden
+	 * behind silhouettes (-1 until checked)
+	 */
+	int simple;
+
+	/*
+	 * half edges on the silhouette for the frame, between a face turned
+	 * towards the screen and one turned away or on the boundary of the
+	 * mesh. Only found for simple shapes
+	 */
+	int *sil;
+	struct hl_box *sil_box;
+	int num_sil;
+	int max_sil;
+	struct tile_bins sil_bins;
+
+	/*
+	 * hidden intervals of the edges, kept from frame to frame. When the
+	 * shape turns around the x or y axis (s->turns changes) only the edges
+	 * that something moved across are dropped (see keep_edges()). The
+	 * intervals of edge i are cache_count[i] intervals starting from
+	 * cache[cache_first[i]], and cache_count[i] is -1 if the edge isn't
+	 * cached yet. Threads only read it while finding intervals, and edges
+	 * are added to it by one thread in between
+	 */
+	int *cache_first;
+	int *cache_count;
+	int max_cache_edges;
+	struct interval *cache;
+	int num_cache;
+	int max_cache;
+	struct interval *spare; /* what's kept of the cache is copied here */
+	int max_spare;
+	unsigned long cache_turns;
+
+	/*
+	 * the shape and the screen at the last frame, to tell how far the
+	 * shape turned since
+	 */
+	int last_valid;
+	point3 *last_screen;
+	int max_last;
+	struct model last_model;
+	point3 last_center;
+	struct viewport last_view;
+
+	/*
+	 * boxes around where silhouettes and faces that turned over swept on
+	 * the screen since the last frame, binned like the faces. A cached
+	 * edge whose own swept box overlaps one of them is found again
+	 */
+	struct hl_box *swept;
+	int num_swept;
+	int max_swept;
+	struct tile_bins swept_bins;
+};
+
+/* prototypes */
+struct hidden_line *hl_create(void);
+int hl_prepare(struct shape *s);
+int hl_edge(struct shape *s, struct edge *edge, struct hl_scratch *sc);
+void hl_cache_edge(struct shape *s, struct edge *edge, struct interval *hidden,
+		   int n);
+uint64_t occlude_block_analytic(struct shape *s, struct point_block *b);
+void hl_destroy(struct hidden_line *hl);
+
+#endif /* HIDDEN_LINE_H */
@@ -4,7 +4,13 @@
 #include "vector.h"
 #include "term_shapes.h"
 
+/*
+ * cosine of the angle within which a point is occluded, cos(pi / 3). As the
+ * method is approximate it can be adjusted
+ */
+#define APPROX_COS 0.5
+
 /* prototypes */
-int occlude_point_approx(struct shape *s, point3 *point);
+uint64_t occlude_block_approx(struct shape *s, struct point_block *b);
 
 #endif /* OCCLUDE_APPROX_H */
@@ -0,0 +1,17 @@
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include "term_shapes.h"
+
+/*
+ * runs of unchanged cells shorter than this between two changed cells are
+ * rewritten rather than moving the cursor over them
+ */
+#define PRESENT_GAP 4
+
+/* prototypes */
+void present_frame(struct shape *s);
+void present_text(struct shape *s, int row, int col, const char *fmt, ...);
+void present_printf(struct shape *s, int row, int col, const char *fmt, ...);
+
+#endif /* PRESENT_H */
@@ -16,6 +16,18 @@ enum edge_occlusion {
 	PARTIAL = 2
 };
 
+/*
+ * projects a point to its position in the grid of dots, keeping its depth
+ */
+static inline
+void
+viewport_project(struct viewport *v, point3 *p, point3 *out)
+{
+	out->x = p->x * v->scale_x + v->off_x;
+	out->y = p->y * v->scale_y + v->off_y;
+	out->z = p->z;
+}
+
 /* prototypes */
 void print_shape(struct shape *s);
 
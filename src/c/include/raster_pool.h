@@ -0,0 +1,162 @@
+#ifndef RASTER_POOL_H
+#define RASTER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "print.h"
+#include "hidden_line.h"
+#include "term_shapes.h"
+
+/* most threads edges can be rasterized with */
+#define MAX_THREADS 64
+
+/*
+ * samples of a PARTIAL edge in a task. The rest of the edges are nearly free
+ * to draw, so up to RASTER_TASK_EDGES of them in a row go in one task
+ */
+#define RASTER_TASK_SAMPLES (2 * OCC_BLOCK)
+#define RASTER_TASK_EDGES 64
+
+/* key of a dot no point has been put in yet */
+#define RASTER_NO_KEY UINT32_MAX
+
+/*
+ * piece of the edges of a frame for a thread to draw: samples from up to to
+ * of the edges at positions first up to end in the order edges are drawn in
+ */
+struct raster_task {
+	int first;
+	int end;
+	long from;
+	long to;
+};
+
+/*
+ * tasks a thread hasn't taken yet, tasks[front] up to tasks[back], packed as
+ * front | back << 32 so both ends move with one compare and swap. The owner
+ * takes from the front and other threads steal from the back. The padding
+ * keeps the deques of different threads out of the same cache line
+ */
+struct raster_deque {
+	_Atomic uint64_t range;
+	char pad[64 - sizeof(uint64_t)];
+};
+
+/*
+ * hidden intervals a thread found for the edges in its range, for ANALYTIC
+ * occlusion. failed is set if there wasn't room for them
+ */
+struct raster_found {
+	struct interval *hidden;
+	int num;
+	int max;
+	int failed;
+};
+
+/*
+ * threads that rasterize the edges of a frame together
+ *
+ * how long an edge takes depends on how much of it is hidden: a PARTIAL edge
+ * is tested for occlusion at every sample, the others aren't at all. So the
+ * edges are cut into tasks, with PARTIAL edges split into ranges of samples,
+ * and dealt out to the threads in order. A thread that runs out of tasks
+ * steals from the others, so none sits idle while another has a backlog
+ *
+ * every thread draws into cells of its own, and tasks run in any order, so
+ * each dot also keeps the key of the point that filled it: its position in
+ * the order every point would be drawn in on one thread. A point with a lower
+ * key takes a dot over, and merging keeps the dot with the lowest key across
+ * threads, which is exactly the first point to reach it in that order
+ */
+struct raster_pool {
+	int num_threads; /* including the thread drawing the frame */
+	pthread_t *threads;
+	struct raster_thread *args;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work; /* a frame was posted, or the pool is ending */
+	pthread_cond_t done; /* the last worker finished its job */
+	unsigned long frame; /* number of frames posted */
+	int running;         /* workers still drawing the frame */
+	int quit;
+
+	/* runs the part of thread i, which is 0 for the calling thread */
+	void (*job)(struct shape *s, int i);
+	struct shape *s;
+
+	/*
+	 * cells and keys of thread i, at cells + i * num_cells and
+	 * keys + i * num_dots. A thread marks the rows it draws into at
+	 * touched + i * rows, and only those rows are merged, then emptied
+	 * again, so the cells and keys of every thread are empty between
+	 * frames
+	 */
+	uint16_t *cells;
+	size_t num_cells;
+	size_t max_cells;
+	uint32_t *keys;
+	size_t num_dots;
+	size_t max_dots;
+	uint8_t *touched;
+	int rows;
+	int cols;
+	size_t max_touched;
+
+	/* tasks of the frame, dealt out to one deque per thread */
+	struct raster_task *tasks;
+	int num_tasks;
+	int max_tasks;
+	struct raster_deque *deques;
+
+	/* per thread: CPU time spent on the frame and tasks stolen */
+	long *busy;
+	int *steals;
+
+	/*
+	 * how much of each edge is hidden, found by the threads before
+	 * drawing. For ANALYTIC occlusion each thread keeps the hidden
+	 * intervals of the edges in its range in found, and they're then
+	 * gathered into hidden by the calling thread. The intervals of edge i
+	 * are hidden_count[i] intervals starting from hidden_first[i] in
+	 * either
+	 */
+	enum edge_occlusion *state;
+	int *hidden_first;
+	int *hidden_count;
+	int max_edges;
+	struct interval *hidden;
+	int num_hidden;
+	int max_hidden;
+	struct raster_found *found;
+
+	/* key of the first sample of the edge at each position */
+	uint32_t *base;
+};
+
+/* what each thread of the pool is started with */
+struct raster_thread {
+	struct raster_pool *pool;
+	int index;
+};
+
+/* prototypes */
+struct raster_pool *raster_pool_create(int num_threads);
+int raster_pool_reserve(struct raster_pool *pool, int rows, int cols,
+			int dots, int num_e);
+int raster_pool_add_found(struct raster_pool *pool, int i, int e,
+			  struct interval *hidden, int n);
+int raster_pool_add_hidden(struct raster_pool *pool, int e,
+			   struct interval *hidden, int n);
+int raster_pool_add_task(struct raster_pool *pool, int first, int end,
+			 long from, long to);
+void raster_pool_deal(struct raster_pool *pool);
+int raster_pool_take(struct raster_pool *pool, int i);
+void raster_pool_run(struct raster_pool *pool, struct shape *s,
+		     void (*job)(struct shape *, int));
+void raster_pool_merge(struct raster_pool *pool, uint16_t *cells,
+		       enum pixel_mode mode);
+void raster_pool_destroy(struct raster_pool *pool);
+
+#endif /* RASTER_POOL_H */
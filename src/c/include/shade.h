@@ -0,0 +1,15 @@
+#ifndef SHADE_H
+#define SHADE_H
+
+#include "term_shapes.h"
+
+/* characters faces are filled with, from least to most lit */
+#define SHADE_RAMP ".:-=+*#%@"
+
+/* direction the light comes from (up, left, and towards the viewer) */
+#define LIGHT {-1, 1, 2}
+
+/* prototypes */
+void shade_faces(struct shape *s);
+
+#endif /* SHADE_H */
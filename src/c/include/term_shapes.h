@@ -18,6 +18,7 @@
 #ifndef TERM_SHAPES_H
 #define TERM_SHAPES_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -38,7 +39,7 @@
 
 #define M_PI 3.14159265358979323846264338327950288
 
-#define MAX_VERTICES 1024 * 10
+#define MAX_VERTICES 1024 * 1024
 #define MAX_EDGES 1024 * 10
 #define MAX_FACES 1024 * 10
 #define MAX_FACE_VERTICES 1024 * 10
@@ -46,20 +47,41 @@
 
 #define SCALE 0.4
 #define E_DENSITY 50
+#define FRAME_RATE 60 /* frames a second the interactive loop aims for */
 #define COP {0, 0, 10000}
 
 typedef struct vector3 point3;
 
+struct framebuffer;
+struct zbuffer;
+struct hidden_line;
+struct raster_pool;
+struct backend;
+
+/* which way the faces on either side of an edge face */
+enum edge_side {
+	EDGE_FRONT,     /* both faces face the center of projection */
+	EDGE_BACK,      /* both faces face away from it */
+	EDGE_SILHOUETTE /* one of each, so the edge is on the outline */
+};
+
 /* edge as the index of two points */
 struct edge {
 	int edge[2];
+	int face[2];         /* faces on either side of the edge, -1 if there's none */
+	int num_faces;       /* faces the edge is on, face[] only has them if <= 2 */
+	enum edge_side side; /* updated every frame by classify_edges() */
 };
 
 /* edge as the index of three points */
 struct face {
 	int num_v;             /* number of vertices on this face */
-	struct vector3 normal; /* normal vector to this face */
 	int *face;             /* array of indices corresponding to vertices on this face */
+	int he;                /* first of the half edges around this face */
+	int outward;           /* 1 if the normal points out of the solid, else -1 */
+	int front;             /* whether the face faces the center of projection */
+	int axis;              /* axis dropped to flatten the face to 2D */
+	int convex;            /* the flattened face is convex */
 };
 
 /* choose which occlusion method to use */
@@ -68,7 +90,20 @@ enum occ_method {
 	APPROX,
 	CONVEX,
 	CONVEX_CLEAR,
-	EXACT   /* not implemented */
+	EXACT,   /* depth buffer of the faces, works for any shape with faces */
+	ANALYTIC /* hidden intervals of every edge from the projected faces */
+};
+
+/* choose how edges are rasterized on to the screen */
+enum raster_method {
+	SAMPLE, /* e_density + 1 points per edge projected one at a time */
+	DDA     /* walk the projected edge cell by cell */
+};
+
+/* choose how finely a cell is divided when rasterizing */
+enum pixel_mode {
+	HALF_BLOCK, /* upper and lower half of a cell */
+	BRAILLE     /* 2x4 dots per cell printed as braille characters */
 };
 
 /*
@@ -82,12 +117,93 @@ enum t_pixel_print {
 	FULL = ';'
 };
 
+/*
+ * maps shape coordinates to fractional positions in the grid of dots on the
+ * screen (half cells or braille dots, depending on the pixel mode). It's
+ * computed once a frame from the size of the screen
+ */
+struct viewport {
+	int rows;       /* screen size in cells */
+	int cols;
+	int dots_x;     /* dots across and down a cell */
+	int dots_y;
+	double scale_x; /* dot = coordinate * scale + offset */
+	double scale_y;
+	double off_x;
+	double off_y;
+};
 
-/* point to be printed in a later step */
-struct point_to_print {
-	double x;
-	double y;
-	enum t_pixel_print t;
+/*
+ * one side of an edge on the boundary of a face. The half edges of a face
+ * link in a loop around it, and the twin of a half edge is the same edge
+ * going the other way around the face on the other side
+ */
+struct half_edge {
+	int origin; /* vertex the half edge starts from */
+	int face;   /* face the half edge goes around */
+	int next;   /* next half edge around the face */
+	int twin;   /* half edge on the other side, -1 if there's none */
+	int edge;   /* index in the list of edges, -1 if it isn't listed */
+};
+
+/*
+ * node of the bounding volume hierarchy over the faces. A leaf holds count
+ * faces starting from first in the list of faces ordered by the hierarchy,
+ * an inner node has no faces and two children, the first of which directly
+ * follows it
+ */
+struct bvh_node {
+	point3 min;  /* corners of the box around every face under the node */
+	point3 max;
+	int right;   /* second child, -1 for a leaf */
+	int first;
+	int count;
+};
+
+/* most points tested for occlusion at once, one per bit of the mask */
+#define OCC_BLOCK 64
+
+/*
+ * points tested for occlusion together, as a structure of arrays so a method
+ * can work on several points at once
+ */
+struct point_block {
+	int n;
+	double x[OCC_BLOCK];
+	double y[OCC_BLOCK];
+	double z[OCC_BLOCK];
+};
+
+/*
+ * points stored as a structure of arrays, a run of each coordinate, so a
+ * transform can work on several points at once
+ */
+struct coords {
+	double *x;
+	double *y;
+	double *z;
+};
+
+/*
+ * places the shape in the world, as world = scale * rot * object + center.
+ * Transforms only change this, and the vertices follow it once a frame
+ */
+struct model {
+	double rot[3][3]; /* rotation, kept orthonormal */
+	double scale;
+};
+
+/*
+ * transforms waiting for the next frame, composed into one so the model only
+ * takes them once a frame however many came in. Turns are composed in the
+ * order they came in, while scaling and moving commute with them
+ */
+struct motion {
+	int turned;       /* rot isn't the identity */
+	int turned_xy;    /* one of the turns was around x or y */
+	double rot[3][3]; /* turns, applied before the rotation of the model */
+	double scale;
+	point3 move;      /* added to the center */
 };
 
 struct autorotate_dir {
@@ -104,29 +220,96 @@ struct shape {
 	int e_density; /* number of points to draw along eatch edge */
 
 	point3 center; /* center of the shape */
+	struct model model; /* rotation and scale around the center */
+	int moved;          /* the model changed since the hierarchy was refit */
+	struct motion motion; /* transforms since the model was last applied */
 
-	point3 *vertices;        /* list of vertices */
+	struct coords object;    /* vertices as read, in object space */
+	point3 *vertices;        /* vertices in world space, from the model */
 	struct edge *edges;      /* list of edges */
 	struct face *faces;      /* list of faces */
+	int convex;              /* no vertex is in front of any face */
+	struct coords object_normals; /* face normals in object space */
+	point3 *normals;         /* face normals turned by the model */
+	point3 *screen;          /* vertices projected to (dot x, dot y, depth) */
+
+	int num_he;                    /* number of half edges */
+	struct half_edge *half_edges;  /* edges around the faces, linked */
+
+	/*
+	 * 2D edge function of every half edge, updated every frame for convex
+	 * occlusion. The a, b, and c coefficients are each in a run of num_he
+	 * values, in the same order as the half edges
+	 */
+	double *edge_fn;
+
+	/*
+	 * vertices of the faces flattened to 2D, updated with the edge
+	 * functions. The u and v of the first vertex of each half edge are
+	 * each in a run of num_he values, for the faces that aren't convex
+	 */
+	double *face_uv;
+
+	int num_nodes;           /* number of nodes in the hierarchy */
+	struct bvh_node *bvh;    /* boxes around the faces, root first */
+	int *bvh_faces;          /* face indices in the order of the leaves */
+
+	/*
+	 * planes of the faces in the order of the leaves, as runs of num_f
+	 * normal x, y, z, and offsets d (normal . point = d). Updated every
+	 * frame for convex occlusion
+	 */
+	double *bvh_planes;
 
 	char *fname; /* file name of the shape coordinates */
 
 	int print_vertices;        /* bool whether or not to print vertices */
 	int print_edges;           /* bool whether or not to print edges */
 	enum occ_method occlusion; /* choose which occlusion method to use */
+	enum raster_method raster; /* choose which raster method to use */
+	enum pixel_mode pixels;    /* choose how finely cells are divided */
+	int fill;                  /* whether faces are filled and shaded */
 	point3 cop;                /* center of projection */
 
-	struct point_to_print *fronts;  /* points detected as not occluded */
-	struct point_to_print *behinds; /* points detected as occluded */
+	/*
+	 * bumped by every rotation around the x or y axis, the only transforms
+	 * that change which parts of the shape hide which on the screen
+	 */
+	unsigned long turns;
+	int sides_valid;           /* edge sides are up to date with the faces */
+
+	struct viewport view;     /* projection for the current frame */
+	struct framebuffer *fb;   /* screen sized cells of points to print */
+	struct zbuffer *zb;       /* depth of the faces for EXACT occlusion */
+	struct hidden_line *hl;   /* faces on the screen for ANALYTIC occlusion */
+	struct raster_pool *pool; /* threads edges are drawn with, or NULL */
+	int threads;              /* number of threads to draw edges with */
+	struct backend *backend;  /* where frames are presented */
+	int quiet;                /* frames are presented without any text */
 
 	int autorotate;            /* whether auto-rotate is on or off */
 	struct autorotate_dir dir; /* direction to rotate the shape in radians */
-	struct timespec interval;  /* interval to redraw shape */
+	struct timespec interval;  /* time it takes to turn the shape by dir */
 
 	FILE *log; /* log file */
 };
 
+/*
+ * appends a point to a block of points to test for occlusion, which must not
+ * be full
+ */
+static inline
+void
+block_add(struct point_block *b, point3 *p)
+{
+	b->x[b->n] = p->x;
+	b->y[b->n] = p->y;
+	b->z[b->n] = p->z;
+	b->n++;
+}
+
 /* prototypes */
-int occlude_point(struct shape *s, point3 *point, struct edge *edge);
+uint64_t occlude_block(struct shape *s, struct point_block *b,
+		       struct edge *edge);
 
 #endif /* TERM_SHAPES_H */
@@ -7,7 +7,9 @@
 void rotate_shape(double, char, struct shape *);
 void scale_shape(double, struct shape *);
 void translate_shape(double, char, struct shape *);
-int resize_points_to_print(struct shape *s);
+void motion_reset(struct motion *);
+void apply_model(struct shape *);
+void autorotate_shape(struct shape *, double);
 void autorotate(struct shape *);
 
 #endif /* TRANSFORM_H */
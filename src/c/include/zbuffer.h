@@ -0,0 +1,40 @@
+#ifndef ZBUFFER_H
+#define ZBUFFER_H
+
+#include <stdint.h>
+
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * bias subtracted from the depth of every face, so the points of an edge
+ * aren't occluded by the faces the edge lies on
+ */
+#define ZB_EPSILON 1e-3
+
+/*
+ * depth and index of the closest face at every dot on the screen (half cells
+ * or braille dots, the same grid the edges are rasterized in). The center of
+ * projection is far down the z axis, so a larger z is closer to the viewer
+ */
+struct zbuffer {
+	int rows; /* in dots */
+	int cols;
+	float *depth;
+	int *face; /* 1 + index of the closest face, 0 where there is none */
+
+	/* character each face is filled with, indexed like face */
+	uint8_t *face_shade;
+	int max_faces;
+
+	double *cross; /* scratch for where a scanline crosses a face */
+	int max_cross;
+};
+
+/* prototypes */
+struct zbuffer *zb_create(void);
+int zb_render(struct shape *s);
+uint64_t occlude_block_zbuffer(struct shape *s, struct point_block *b);
+void zb_destroy(struct zbuffer *zb);
+
+#endif /* ZBUFFER_H */
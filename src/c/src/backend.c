@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "backend.h"
+#include "term_shapes.h"
+
+/*
+ * allocates the in-memory screen, filled with blanks
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+static
+int
+memory_init(struct backend *b)
+{
+	int i;
+
+	b->grid = calloc((size_t) b->rows * b->cols + 1, BACKEND_CELL);
+	if (b->grid == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < b->rows * b->cols; ++i) {
+		b->grid[i * BACKEND_CELL] = ' ';
+	}
+
+	b->frame = 0;
+
+	return 0;
+}
+
+static
+void
+memory_end(struct backend *b)
+{
+	free(b->grid);
+	b->grid = NULL;
+}
+
+static
+void
+memory_size(struct backend *b, int *rows, int *cols)
+{
+	*rows = b->rows;
+	*cols = b->cols;
+}
+
+/*
+ * number of bytes in the UTF-8 character starting with the byte c
+ */
+static
+int
+utf8_len(unsigned char c)
+{
+	if (c >= 0xf0) {
+		return 4;
+	} else if (c >= 0xe0) {
+		return 3;
+	} else if (c >= 0xc0) {
+		return 2;
+	}
+
+	return 1;
+}
+
+/*
+ * copies the characters into the in-memory screen. Attributes aren't kept,
+ * and the bytes counted are just the characters since there's no cursor
+ * movement
+ */
+static
+long
+memory_put(struct backend *b, int row, int col,
+	   const char *str, int len, enum backend_attr attr)
+{
+	int i, n;
+	long bytes;
+	char *cell;
+
+	(void) attr;
+
+	if (row < 0 || row >= b->rows) {
+		return 0;
+	}
+
+	bytes = 0;
+
+	for (i = 0; i < len && col < b->cols; i += n, ++col) {
+		n = utf8_len(str[i]);
+		if (i + n > len) {
+			break;
+		}
+
+		if (col < 0) {
+			continue;
+		}
+
+		cell = &(b->grid[(row * b->cols + col) * BACKEND_CELL]);
+		memset(cell, 0, BACKEND_CELL);
+		memcpy(cell, &(str[i]), n);
+
+		bytes += n;
+	}
+
+	return bytes;
+}
+
+static
+long
+memory_flush(struct backend *b)
+{
+	b->frame++;
+
+	return 0;
+}
+
+/*
+ * input for the headless backends is read from stdin, so a session can be
+ * scripted by piping keys in
+ */
+static
+int
+memory_read_key(struct backend *b)
+{
+	int c;
+
+	(void) b;
+
+	c = getchar();
+	if (c == EOF) {
+		return 'q';
+	}
+
+	return c;
+}
+
+/*
+ * dumps the in-memory screen to stdout with trailing blanks removed from each
+ * row, followed by a line separating it from the next frame
+ */
+static
+long
+text_flush(struct backend *b)
+{
+	int row, col, len;
+	char *line, *cell;
+
+	for (row = 0; row < b->rows; ++row) {
+		line = &(b->grid[row * b->cols * BACKEND_CELL]);
+
+		for (len = b->cols; len > 0; --len) {
+			cell = &(line[(len - 1) * BACKEND_CELL]);
+			if (cell[0] != ' ' || cell[1] != '\0') {
+				break;
+			}
+		}
+
+		for (col = 0; col < len; ++col) {
+			cell = &(line[col * BACKEND_CELL]);
+			fwrite(cell, 1, utf8_len(cell[0]), stdout);
+		}
+
+		putchar('\n');
+	}
+
+	printf("-- frame %d --\n", b->frame);
+	fflush(stdout);
+
+	b->frame++;
+
+	return 0;
+}
+
+static struct backend memory_backend = {
+	.name = "memory",
+	.interactive = 0,
+	.init = memory_init,
+	.end = memory_end,
+	.size = memory_size,
+	.put = memory_put,
+	.flush = memory_flush,
+	.read_key = memory_read_key,
+	.rows = BACKEND_ROWS,
+	.cols = BACKEND_COLS
+};
+
+static struct backend text_backend = {
+	.name = "text",
+	.interactive = 0,
+	.init = memory_init,
+	.end = memory_end,
+	.size = memory_size,
+	.put = memory_put,
+	.flush = text_flush,
+	.read_key = memory_read_key,
+	.rows = BACKEND_ROWS,
+	.cols = BACKEND_COLS
+};
+
+/*
+ * looks up a backend by name
+ *
+ * returns NULL if there's no backend with that name
+ */
+struct backend *
+backend_find(const char *name)
+{
+#if USE_NCURSES
+	if (strcmp(name, "ncurses") == 0) {
+		return backend_ncurses();
+	}
+#endif
+
+	if (strcmp(name, "memory") == 0) {
+		return &memory_backend;
+	}
+
+	if (strcmp(name, "text") == 0) {
+		return &text_backend;
+	}
+
+	return NULL;
+}
+
+/*
+ * the terminal when ncurses is compiled in, else the in-memory screen
+ */
+struct backend *
+backend_default(void)
+{
+#if USE_NCURSES
+	return backend_ncurses();
+#else
+	return &memory_backend;
+#endif
+}
+
+/*
+ * sets the screen size of a headless backend, before it's initialized. The
+ * ncurses backend always uses the size of the terminal
+ */
+void
+backend_set_size(struct backend *b, int rows, int cols)
+{
+	b->rows = rows;
+	b->cols = cols;
+}
@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ncurses.h>
+#include <term.h>
+
+#include "backend.h"
+#include "term_shapes.h"
+
+#if USE_NCURSES
+/*
+ * the count of bytes the drawing thread has written, kept by the kernel.
+ * curses writes the screen to the terminal's file descriptor itself, so the
+ * bytes can't be counted on the way through a FILE handed to newterm(), but
+ * only the thread calling refresh() writes them. -1 if the system doesn't
+ * keep the count, in which case the bytes are estimated as they're put
+ */
+static int io_fd = -1;
+
+/*
+ * bytes the thread that opened io_fd has passed to write() so far
+ *
+ * returns the count, or -1 if it can't be read
+ */
+static
+long
+written(void)
+{
+	char buf[512], *w;
+	ssize_t n;
+
+	n = pread(io_fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0) {
+		return -1;
+	}
+
+	buf[n] = '\0';
+
+	w = strstr(buf, "wchar:");
+	if (w == NULL) {
+		return -1;
+	}
+
+	return strtol(w + strlen("wchar:"), NULL, 10);
+}
+
+/*
+ * length of a terminfo string, used to estimate the bytes a put writes
+ */
+static
+long
+cap_len(const char *cap)
+{
+	if (cap == NULL || cap == (char *) -1) {
+		return 0;
+	}
+
+	return strlen(cap);
+}
+
+/*
+ * bytes needed to move the cursor to row, col
+ */
+static
+long
+move_cost(int row, int col)
+{
+	if (cursor_address == NULL) {
+		return 0;
+	}
+
+	return cap_len(tiparm(cursor_address, row, col));
+}
+
+/*
+ * bytes needed to switch to an attribute
+ */
+static
+long
+attr_cost(enum backend_attr attr)
+{
+	long len;
+
+	len = cap_len(exit_attribute_mode);
+
+	if (attr == ATTR_BOLD) {
+		len += cap_len(enter_bold_mode);
+	} else if (attr == ATTR_DIM) {
+		len += cap_len(enter_dim_mode);
+	}
+
+	return len;
+}
+
+static
+int
+ncurses_init(struct backend *b)
+{
+	/* braille characters are printed as UTF-8 in the user's locale */
+	setlocale(LC_ALL, "");
+
+	io_fd = open("/proc/thread-self/io", O_RDONLY);
+	if (io_fd >= 0 && written() < 0) {
+		close(io_fd);
+		io_fd = -1;
+	}
+
+	b->estimated = io_fd < 0;
+
+	/* start ncurses mode */
+	initscr();
+	noecho();
+	cbreak();
+	keypad(stdscr, TRUE);
+	curs_set(0);
+
+	return 0;
+}
+
+static
+void
+ncurses_end(struct backend *b)
+{
+	(void) b;
+
+	/* end ncurses mode */
+	endwin();
+
+	if (io_fd >= 0) {
+		close(io_fd);
+		io_fd = -1;
+	}
+}
+
+static
+void
+ncurses_size(struct backend *b, int *rows, int *cols)
+{
+	(void) b;
+
+	getmaxyx(stdscr, *rows, *cols);
+}
+
+static
+long
+ncurses_put(struct backend *b, int row, int col,
+	    const char *str, int len, enum backend_attr attr)
+{
+	long bytes;
+
+	bytes = b->estimated ? move_cost(row, col) + len : 0;
+
+	switch (attr) {
+	case ATTR_NORMAL:
+		attrset(A_NORMAL);
+		break;
+
+	case ATTR_BOLD:
+		attrset(A_BOLD);
+		bytes += b->estimated ? attr_cost(attr) : 0;
+		break;
+
+	case ATTR_DIM:
+		attrset(A_DIM);
+		bytes += b->estimated ? attr_cost(attr) : 0;
+		break;
+	}
+
+	mvaddnstr(row, col, str, len);
+	attrset(A_NORMAL);
+
+	return bytes;
+}
+
+/*
+ * refreshes the screen, counting the bytes curses wrote to the terminal to
+ * do it
+ */
+static
+long
+ncurses_flush(struct backend *b)
+{
+	long before, after;
+
+	if (b->estimated) {
+		refresh();
+		return 0;
+	}
+
+	before = written();
+	refresh();
+	after = written();
+
+	return before >= 0 && after >= before ? after - before : 0;
+}
+
+/*
+ * a key from ncurses as a key for the loop, which knows nothing of ncurses
+ */
+static
+int
+ncurses_key(int c)
+{
+	if (c == ERR) {
+		return BACKEND_NO_KEY;
+	} else if (c == KEY_RESIZE) {
+		return BACKEND_RESIZE;
+	}
+
+	return c;
+}
+
+static
+int
+ncurses_read_key(struct backend *b)
+{
+	(void) b;
+
+	return ncurses_key(getch());
+}
+
+static
+int
+ncurses_poll_key(struct backend *b)
+{
+	int c;
+
+	(void) b;
+
+	nodelay(stdscr, TRUE);
+	c = getch();
+	nodelay(stdscr, FALSE);
+
+	return ncurses_key(c);
+}
+
+static struct backend ncurses_backend = {
+	.name = "ncurses",
+	.interactive = 1,
+	.init = ncurses_init,
+	.end = ncurses_end,
+	.size = ncurses_size,
+	.put = ncurses_put,
+	.flush = ncurses_flush,
+	.read_key = ncurses_read_key,
+	.poll_key = ncurses_poll_key
+};
+
+struct backend *
+backend_ncurses(void)
+{
+	return &ncurses_backend;
+}
+#endif
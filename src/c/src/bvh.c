@@ -0,0 +1,343 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "bvh.h"
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * component of a point along an axis (0 for x, 1 for y, 2 for z)
+ */
+static inline
+double
+axis_of(point3 *p, int axis)
+{
+	return axis == 0 ? p->x : axis == 1 ? p->y : p->z;
+}
+
+/*
+ * grows the box min, max to contain every vertex of a face
+ */
+static
+void
+face_bounds(struct shape *s, int f, point3 *min, point3 *max)
+{
+	int k;
+	point3 *v;
+	struct face *face;
+
+	face = &(s->faces[f]);
+
+	for (k = 0; k < face->num_v; ++k) {
+		v = &(s->vertices[face->face[k]]);
+
+		min->x = fmin(min->x, v->x);
+		min->y = fmin(min->y, v->y);
+		min->z = fmin(min->z, v->z);
+		max->x = fmax(max->x, v->x);
+		max->y = fmax(max->y, v->y);
+		max->z = fmax(max->z, v->z);
+	}
+}
+
+/*
+ * box around the faces of a leaf, or around both children of an inner node,
+ * whose boxes have to be up to date
+ */
+static
+void
+node_bounds(struct shape *s, int n)
+{
+	int i;
+	struct bvh_node *node, *l, *r;
+
+	node = &(s->bvh[n]);
+
+	if (node->right < 0) {
+		node->min = (point3) {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+		node->max = (point3) {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+
+		for (i = node->first; i < node->first + node->count; ++i) {
+			face_bounds(s, s->bvh_faces[i], &(node->min), &(node->max));
+		}
+
+		return;
+	}
+
+	l = &(s->bvh[n + 1]);
+	r = &(s->bvh[node->right]);
+
+	node->min.x = fmin(l->min.x, r->min.x);
+	node->min.y = fmin(l->min.y, r->min.y);
+	node->min.z = fmin(l->min.z, r->min.z);
+	node->max.x = fmax(l->max.x, r->max.x);
+	node->max.y = fmax(l->max.y, r->max.y);
+	node->max.z = fmax(l->max.z, r->max.z);
+}
+
+/*
+ * reorders count faces starting from first so that the face with the k-th
+ * smallest centroid along an axis is at k, with the ones before it no larger
+ * and the ones after it no smaller (quickselect)
+ */
+static
+void
+select_faces(struct shape *s, point3 *centroid, int first, int count,
+	     int k, int axis)
+{
+	int lo, hi, i, j, tmp;
+	double pivot;
+
+	lo = first;
+	hi = first + count - 1;
+
+	while (lo < hi) {
+		pivot = axis_of(&centroid[s->bvh_faces[(lo + hi) / 2]], axis);
+		i = lo;
+		j = hi;
+
+		while (i <= j) {
+			while (axis_of(&centroid[s->bvh_faces[i]], axis) < pivot) {
+				++i;
+			}
+			while (axis_of(&centroid[s->bvh_faces[j]], axis) > pivot) {
+				--j;
+			}
+
+			if (i <= j) {
+				tmp = s->bvh_faces[i];
+				s->bvh_faces[i++] = s->bvh_faces[j];
+				s->bvh_faces[j--] = tmp;
+			}
+		}
+
+		if (k <= j) {
+			hi = j;
+		} else if (k >= i) {
+			lo = i;
+		} else {
+			return;
+		}
+	}
+}
+
+/*
+ * builds the subtree over count faces starting from first, splitting them in
+ * half along the longest axis of the box around their centroids. Splitting by
+ * count keeps the tree balanced, so it's at most about log2(faces) deep
+ *
+ * returns the index of the node
+ */
+static
+int
+build_node(struct shape *s, point3 *centroid, int first, int count)
+{
+	int n, i, axis, half;
+	point3 min, max, *c;
+	struct bvh_node *node;
+
+	n = s->num_nodes++;
+	node = &(s->bvh[n]);
+	node->right = -1;
+	node->first = first;
+	node->count = count;
+
+	if (count <= BVH_LEAF_SIZE) {
+		node_bounds(s, n);
+		return n;
+	}
+
+	min = (point3) {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+	max = (point3) {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+	for (i = first; i < first + count; ++i) {
+		c = &centroid[s->bvh_faces[i]];
+
+		min.x = fmin(min.x, c->x);
+		min.y = fmin(min.y, c->y);
+		min.z = fmin(min.z, c->z);
+		max.x = fmax(max.x, c->x);
+		max.y = fmax(max.y, c->y);
+		max.z = fmax(max.z, c->z);
+	}
+
+	axis = 0;
+	if (max.y - min.y > max.x - min.x) {
+		axis = 1;
+	}
+	if (max.z - min.z > axis_of(&max, axis) - axis_of(&min, axis)) {
+		axis = 2;
+	}
+
+	half = count / 2;
+	select_faces(s, centroid, first, count, first + half, axis);
+
+	build_node(s, centroid, first, half);
+	i = build_node(s, centroid, first + half, count - half);
+
+	node = &(s->bvh[n]);
+	node->right = i;
+	node->count = 0;
+	node_bounds(s, n);
+
+	return n;
+}
+
+/*
+ * builds a bounding volume hierarchy over the faces, so a ray only has to be
+ * tested against the faces along its path instead of every face. Transforms
+ * move faces but don't change which faces are close to each other, so it's
+ * only built once when the shape is loaded, and refit_bvh() keeps the boxes up
+ * to date after that
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+int
+build_bvh(struct shape *s)
+{
+	int i, k;
+	point3 *centroid;
+	struct face *face;
+
+	s->num_nodes = 0;
+	s->bvh = NULL;
+	s->bvh_faces = NULL;
+	s->bvh_planes = NULL;
+
+	if (s->num_f == 0) {
+		return 0;
+	}
+
+	/* a binary tree with a face or more per leaf */
+	s->bvh = malloc(sizeof(struct bvh_node) * (2 * s->num_f - 1));
+	s->bvh_faces = malloc(sizeof(int) * s->num_f);
+	s->bvh_planes = malloc(sizeof(double) * 4 * s->num_f);
+	centroid = malloc(sizeof(point3) * s->num_f);
+
+	if (s->bvh == NULL || s->bvh_faces == NULL || s->bvh_planes == NULL ||
+	    centroid == NULL) {
+		free(s->bvh);
+		free(s->bvh_faces);
+		free(s->bvh_planes);
+		free(centroid);
+		s->bvh = NULL;
+		s->bvh_faces = NULL;
+		s->bvh_planes = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[i]);
+
+		centroid[i] = (point3) {0, 0, 0};
+		for (k = 0; k < face->num_v; ++k) {
+			vector3_add(&centroid[i], &(s->vertices[face->face[k]]),
+				    &centroid[i]);
+		}
+
+		vector3_mult(&centroid[i], 1.0 / face->num_v, &centroid[i]);
+		s->bvh_faces[i] = i;
+	}
+
+	build_node(s, centroid, 0, s->num_f);
+
+	free(centroid);
+
+	return 0;
+}
+
+/*
+ * recomputes the boxes of the hierarchy for where the vertices are now,
+ * without changing which faces are under which node. Children always come
+ * after their parent, so going backwards updates the children first
+ */
+void
+refit_bvh(struct shape *s)
+{
+	int n;
+
+	for (n = s->num_nodes - 1; n >= 0; --n) {
+		node_bounds(s, n);
+	}
+}
+
+/*
+ * whether the segment from o to o + d crosses a box, by clipping the
+ * parameter of the segment to the slab between the sides of the box along
+ * each axis. inv is 1 / d, which is infinite along an axis the segment is
+ * parallel to
+ */
+static
+int
+segment_hits_box(point3 *o, point3 *inv, struct bvh_node *node)
+{
+	double t0, t1, lo, hi;
+
+	t0 = 0;
+	t1 = 1;
+
+	lo = (node->min.x - o->x) * inv->x;
+	hi = (node->max.x - o->x) * inv->x;
+	t0 = fmax(t0, fmin(lo, hi));
+	t1 = fmin(t1, fmax(lo, hi));
+
+	lo = (node->min.y - o->y) * inv->y;
+	hi = (node->max.y - o->y) * inv->y;
+	t0 = fmax(t0, fmin(lo, hi));
+	t1 = fmin(t1, fmax(lo, hi));
+
+	lo = (node->min.z - o->z) * inv->z;
+	hi = (node->max.z - o->z) * inv->z;
+	t0 = fmax(t0, fmin(lo, hi));
+	t1 = fmin(t1, fmax(lo, hi));
+
+	return t0 <= t1;
+}
+
+/*
+ * calls hit for every leaf whose box the segment from p0 to p1 passes
+ * through, with the range of its faces in the order of the leaves (first and
+ * count), until hit returns nonzero. The faces of a leaf are next to each
+ * other there, so hit can test them together
+ *
+ * returns 1 if hit returned nonzero for a leaf, else 0
+ */
+int
+bvh_segment(struct shape *s, point3 *p0, point3 *p1,
+	    int (*hit)(struct shape *, int, int, void *), void *arg)
+{
+	int n, top, stack[BVH_STACK];
+	point3 d, inv;
+	struct bvh_node *node;
+
+	if (s->num_nodes == 0) {
+		return 0;
+	}
+
+	vector3_sub(p1, p0, &d);
+	inv.x = 1 / d.x;
+	inv.y = 1 / d.y;
+	inv.z = 1 / d.z;
+
+	top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		n = stack[--top];
+		node = &(s->bvh[n]);
+
+		if (!segment_hits_box(p0, &inv, node)) {
+			continue;
+		}
+
+		if (node->right < 0) {
+			if (hit(s, node->first, node->count, arg)) {
+				return 1;
+			}
+		} else {
+			stack[top++] = node->right;
+			stack[top++] = n + 1;
+		}
+	}
+
+	return 0;
+}
@@ -1,196 +1,162 @@
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "convex_occlusion.h"
+#include "half_edge.h"
+#include "bvh.h"
 #include "vector.h"
 #include "term_shapes.h"
 
 /*
- * determines whether the point p2 lies on the line segment given by p0 and p1
- *
- * returns 1 if true and 0 if false
+ * coordinates of a point in the plane of a face flattened along an axis, by
+ * dropping that coordinate
  */
-
-static
-int
-on_segment(point3 *p0, point3 *p1, point3 *p2)
+static inline
+void
+flatten(point3 *p, int axis, double *u, double *v)
 {
-	if (p2->x <= fmax(p0->x, p1->x) && p2->x >= fmin(p0->x, p1->x) &&
-	    p2->y <= fmax(p0->y, p1->y) && p2->y >= fmin(p0->y, p1->y) &&
-	    p2->z <= fmax(p0->z, p1->z) && p2->z >= fmin(p0->z, p1->z)) {
-		return 1;
+	switch (axis) {
+	case 0:
+		*u = p->y;
+		*v = p->z;
+		break;
+	case 1:
+		*u = p->z;
+		*v = p->x;
+		break;
+	default:
+		*u = p->x;
+		*v = p->y;
+		break;
 	}
-
-	return 0;
 }
 
 /*
- * returns 0 if p0, p1, p2 are colinear
- * returns 1 if points are clockwise
- * returns 2 if points are counterclockwise
+ * whether the point (u, v) is on the inside of all n edge functions
+ * a * u + b * v + c, which is where every one of them is at least 0
  *
- * the points are colinear if n = <0, 0, 0>
- */
-static
-int
-orientation(point3 *p0, point3 *p1, point3 *p2, struct face *face)
-{
-	double dot;
-	point3 t0, t1, t2;
-
-	/*
-	 * if n ⋅ ((p1 - p0) × (p2 - p0)) < 0 then the points are clockwise
-	 * if n ⋅ ((p1 - p0) × (p2 - p0)) > 0 then the points are counterclockwise
-	 * if n ⋅ ((p1 - p0) × (p2 - p0)) = 0 then the points are colinear
-	 */
-
-	vector3_sub(p1, p0, &t0);
-	vector3_sub(p2, p0, &t1);
-
-	/* t0 × t1 */
-	vector3_cross(&t0, &t1, &t2);
-
-	/* normal ⋅ t2 */
-	dot = vector3_dot(&(face->normal), &t2);
-
-	if (dot < 0) {        /* clockwise */
-		return 1;
-	} else if (dot > 0) { /* counterclockwise */
-		return 2;
-	} else {              /* colinear */
-		return 0;
-	}
-}
-
-/*
- * determine whether these two line segments intersect
+ * with SSE2 two edges are tested per instruction, and the test only branches
+ * once on all of them
  *
- * returns 1 if they intersect, 0 if they don't
+ * returns 1 if the point is inside, and 0 if not
  */
 static
 int
-intersects(point3 *f0, point3 *f1, point3 *inter,
-	   point3 *far, struct face *face)
+inside_edges(const double *a, const double *b, const double *c, int n,
+	     double u, double v)
 {
-	int o0, o1, o2, o3;
+	int i;
+#ifdef __SSE2__
+	__m128d vu, vv, zero, e, out;
+#endif
 
-	/* find orientations for the general and special cases */
-	o0 = orientation(f0, f1, inter, face);
-	o1 = orientation(f0, f1, far, face);
-	o2 = orientation(inter, far, f0, face);
-	o3 = orientation(inter, far, f1, face);
+	i = 0;
 
-	/* general case */
-	if (o0 != o1 && o2 != o3) {
-		return 1;
+#ifdef __SSE2__
+	vu = _mm_set1_pd(u);
+	vv = _mm_set1_pd(v);
+	zero = _mm_setzero_pd();
+	out = zero;
+
+	for (; i + 2 <= n; i += 2) {
+		e = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&a[i]), vu),
+					  _mm_mul_pd(_mm_loadu_pd(&b[i]), vv)),
+			       _mm_loadu_pd(&c[i]));
+		out = _mm_or_pd(out, _mm_cmplt_pd(e, zero));
 	}
 
-	/* special cases for colinear */
-	/* f0, f1, and inter are colinear and inter lies on the segment f0, f1 */
-	if (o0 == 0 && on_segment(f0, f1, inter)) {
-		return 1;
-	}
-	/* f0, f1, and far are colinear and far lies on the segment f0, f1 */
-	else if (o1 == 0 && on_segment(f0, f1, far)) {
-		return 1;
-	}
-	/* inter, far, and f0 are colinear and f0 lies on the segment inter, far */
-	else if (o2 == 0 && on_segment(inter, far, f0)) {
-		return 1;
+	if (_mm_movemask_pd(out)) {
+		return 0;
 	}
-	/* inter, far, and f1 are colinear and f1 lies on the segment inter, far */
-	else if (o3 == 0 && on_segment(inter, far, f1)) {
-		return 1;
+#endif
+
+	for (; i < n; ++i) {
+		if (a[i] * u + b[i] * v + c[i] < 0) {
+			return 0;
+		}
 	}
 
-	return 0;
+	return 1;
 }
 
 /*
- * determines whether a point is inside the polygon named "face"
+ * whether the point (u, v) is inside of the n flattened vertices of a face, by
+ * the even-odd rule: a ray from the point along u crosses the edges of the
+ * face an odd number of times. That works for faces that aren't convex or
+ * that cross themselves, like the pentagrams of star polyhedra
  *
  * returns 1 if the point is inside, and 0 if not
  */
 static
 int
-is_inside(struct shape *s, point3 *inter, point3 *far, struct face *face)
+inside_even_odd(const double *fu, const double *fv, int n, double u, double v)
 {
-	int count, i, next_v;
+	int k, inside;
+	double pu, pv, qu, qv;
 
-	/*
-	 * count number of intersections from the line segment with the polygon
-	 */
-	count = 0;
-	i = 0;
-	while (1) {
-		/* next vertex */
-		next_v = (i + 1) % face->num_v;
+	inside = 0;
+	pu = fu[n - 1];
+	pv = fv[n - 1];
 
-		/*
-		 * first check if the line segment from inter to far intersects
-		 * the edge from the face vertices with indices i and next_v
-		 */
-		if (intersects(&(s->vertices[face->face[i]]),
-			       &(s->vertices[face->face[next_v]]), inter, far, face)) {
-			/*
-			 * if the point inter is colinear with the line segment
-			 * given from i and next_v, check if it lies on the
-			 * segment
-			 */
-			if (orientation(&(s->vertices[face->face[i]]), inter,
-				        &(s->vertices[face->face[next_v]]), face) == 0) {
-				return on_segment(&(s->vertices[face->face[i]]),
-						  &(s->vertices[face->face[next_v]]), inter);
-			}
+	for (k = 0; k < n; ++k) {
+		qu = fu[k];
+		qv = fv[k];
 
-			count++;
+		/* a point on an edge is inside, like it is for convex faces */
+		if ((qu - pu) * (v - pv) == (qv - pv) * (u - pu) &&
+		    u >= fmin(pu, qu) && u <= fmax(pu, qu) &&
+		    v >= fmin(pv, qv) && v <= fmax(pv, qv)) {
+			return 1;
 		}
 
-		i = next_v;
-
-		/* exit condition */
-		if (i == 0) {
-			break;
+		if ((pv > v) != (qv > v) &&
+		    u < pu + (v - pv) * (qu - pu) / (qv - pv)) {
+			inside = !inside;
 		}
+
+		pu = qu;
+		pv = qv;
 	}
 
-	return count % 2 == 1;
+	return inside;
 }
 
 /*
- * determine whether a point is contained within a given polygon
+ * determine whether a point on the plane of a face is contained within the
+ * polygon of the face
  *
- * for this program, the point comes from the intersection given in
- * occlude_point_convex(), and we determine whether the point intersects the
- * plane within the boundaries of the vertices that define the face of the
- * polyhedron being rendered
+ * the point is already on the plane, so this is a 2D test in the coordinates
+ * the face was flattened to by project_faces(). A point is inside a convex
+ * face when it's on the inner side of the edge function of every edge (or on
+ * an edge). Faces that aren't convex are tested with the even-odd rule on
+ * their flattened vertices instead
+ *
+ * returns 1 if the point is inside, and 0 if not
  */
 static
 int
-point_in_polygon(struct shape *s, point3 *inter, struct face *face,
-		 point3 *coeffs, double d)
+point_in_polygon(struct shape *s, point3 *inter, int f)
 {
-	double z;
+	int n;
+	double u, v;
+	struct face *face;
 
-	/*
-	 * we need a point on the same plane as the face, but far off one side
-	 * to determine how many edges are intersected by the line segment from
-	 * the intersection point and the far off distance point.
-	 *
-	 * using a large x value, and y value of 0, we can determine the z
-	 * value that corresponds to a point on the plane with the equation:
-	 * 	z = (d - ax - by) / c
-	 * We simply use x = 10000 and y = 0, and plug in the coefficients
-	 * passed into this function
-	 */
+	face = &(s->faces[f]);
+	n = s->num_he;
 
-	z = (d - (coeffs->x * 10000) - (coeffs->y * 0)) / coeffs->z;
+	flatten(inter, face->axis, &u, &v);
 
-	/*
-	 * now the line segment is defined by the points inter and
-	 * {10000, 0, z}
-	 */
+	if (!face->convex) {
+		return inside_even_odd(&(s->face_uv[face->he]),
+				       &(s->face_uv[n + face->he]), face->num_v,
+				       u, v);
+	}
 
-	return is_inside(s, inter, &((point3) {10000, 0, z}), face);
+	return inside_edges(&(s->edge_fn[face->he]), &(s->edge_fn[n + face->he]),
+			    &(s->edge_fn[2 * n + face->he]), face->num_v, u, v);
 }
 
 /*
@@ -207,99 +173,126 @@ is_between(point3 *p0, point3 *p1, point3 *p2)
 		(p2->z < p0->z && p0->z < p1->z));
 }
 
+/* what leaf_occludes() needs to know besides the faces */
+struct occlude_query {
+	point3 *point;
+	struct edge *edge;
+	int vertex; /* the vertex of the edge the point is, or -1 */
+};
+
 /*
- * occlusion method that works for convex shapes
- *
- * returns 0 if point should be rendered, else 1
+ * returns 1 if vertex v is a corner of face f, 0 otherwise
  */
+static
 int
-occlude_point_convex(struct shape *s, point3 *point, struct edge *edge)
+face_has_vertex(struct shape *s, int f, int v)
 {
-	int i, k, next_v, flag;
-	double d, t;
-	point3 n, inter;
+	int k;
 
-	/*
-	 * iterate through every face in the shape and determine whether the
-	 * ray between the center of projection and input point intersects a
-	 * face
-	 *
-	 * note: precomputing the equations for the faces would speed this up
-	 */
+	for (k = 0; k < s->faces[f].num_v; ++k) {
+		if (s->faces[f].face[k] == v) {
+			return 1;
+		}
+	}
 
-	flag = 0;
-	for (i = 0; i < s->num_f; ++i) {
+	return 0;
+}
 
-		/*
-		 * if the point is on an edge that constitutes this face, don't
-		 * consider this face
-		 *
-		 * also check specifically if the edge passed in is invalid (in
-		 * the case where the point being tested for occlusion is a
-		 * vertex)
-		 */
+/*
+ * whether the ray between the center of projection and a point is blocked by
+ * a face of a leaf of the bounding volume hierarchy
+ *
+ * with the parameterized equation of the plane of a face given as:
+ * 	ax + by + cz = d
+ * where a, b, and c are the normal, the line between the point we're
+ * evaluating and the center of projection is given parametrically (where p
+ * is the point and cop is the center of projection):
+ * 	r(t) = <x_p, y_p, z_p> + t<x_cop - x_p, y_cop - y_p, z_cop - z_p>
+ * and the intersection is found by plugging the line into the equation of
+ * the plane and solving for t
+ *
+ * the planes of the faces of a leaf are next to each other in the structure
+ * of arrays s->bvh_planes, so t is solved for all of them at once, two faces
+ * per instruction with SSE2, before any face is tested further
+ *
+ * returns 1 if a face is in front of the point, else 0
+ */
+static
+int
+leaf_occludes(struct shape *s, int first, int count, void *arg)
+{
+	int i, f;
+	double t[BVH_LEAF_SIZE];
+	const double *nx, *ny, *nz, *d;
+	point3 r, inter, *point;
+	struct occlude_query *q;
+#ifdef __SSE2__
+	__m128d px, py, pz, rx, ry, rz, np, nr;
+#endif
 
-		if (edge->edge[0] < 0 || edge->edge[1] < 0) {
-			continue;
-		}
+	q = arg;
+	point = q->point;
 
-		k = 0;
-		while (1) {
-			next_v = (k + 1) % s->faces[i].num_v;
+	nx = &(s->bvh_planes[first]);
+	ny = nx + s->num_f;
+	nz = ny + s->num_f;
+	d = nz + s->num_f;
 
-			if ((edge->edge[0] == s->faces[i].face[k] &&
-			     edge->edge[1] == s->faces[i].face[next_v]) ||
-			    (edge->edge[0] == s->faces[i].face[next_v] &&
-			     edge->edge[1] == s->faces[i].face[k])) {
-				flag = 1;
-				break;
-			}
+	vector3_sub(&(s->cop), point, &r);
 
-			k = next_v;
+	i = 0;
 
-			if (k == 0) {
-				break;
-			}
-		}
+#ifdef __SSE2__
+	px = _mm_set1_pd(point->x);
+	py = _mm_set1_pd(point->y);
+	pz = _mm_set1_pd(point->z);
+	rx = _mm_set1_pd(r.x);
+	ry = _mm_set1_pd(r.y);
+	rz = _mm_set1_pd(r.z);
+
+	for (; i + 2 <= count; i += 2) {
+		np = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&nx[i]), px),
+					   _mm_mul_pd(_mm_loadu_pd(&ny[i]), py)),
+				_mm_mul_pd(_mm_loadu_pd(&nz[i]), pz));
+		nr = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&nx[i]), rx),
+					   _mm_mul_pd(_mm_loadu_pd(&ny[i]), ry)),
+				_mm_mul_pd(_mm_loadu_pd(&nz[i]), rz));
+
+		_mm_storeu_pd(&t[i],
+			      _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(&d[i]), np), nr));
+	}
+#endif
 
-		if (flag) {
-			flag = 0;
-			continue;
-		}
+	for (; i < count; ++i) {
+		t[i] = (d[i] - (nx[i] * point->x + ny[i] * point->y +
+				nz[i] * point->z)) /
+		       (nx[i] * r.x + ny[i] * r.y + nz[i] * r.z);
+	}
 
-		n = s->faces[i].normal;
+	for (i = 0; i < count; ++i) {
+		f = s->bvh_faces[first + i];
 
 		/*
-		 * with the parameterized equation of the plane given as:
-		 * 	ax + by + cz = d
-		 * a is the value n.x, b is the value n.y, z is the value n.z
-		 * and d is given by solving ax + by + cz = 0, where x, y, and
-		 * z are the x, y, and z from any one of the intial points
+		 * if the point is on an edge that constitutes this face,
+		 * don't consider this face
 		 */
-		d = vector3_dot(&n, &(s->vertices[s->faces[i].face[0]]));
+		if (edge_on_face(s, q->edge, f)) {
+			continue;
+		}
 
 		/*
-		 * the intersection of the line between the point we're
-		 * evaluating and the center of projection with the face-plane
-		 * is given by finding the parametric form of the line (where p
-		 * is the point we're evaluating and cop is the center of
-		 * projection point:
-		 * 	r(t) = <x_p, y_p, z_p> + t<x_cop - x_p, y_cop - y_p, z_cop - z_p>
-		 * After substituting these points in, we can then solve for z
-		 * by plugging in the parametric form of the line to our
-		 * equation of the plane.
+		 * nor a face with the point on one of its corners. It can't
+		 * be in front of the point, but where the ray meets its plane
+		 * is rounded, so the test below would be a coin toss
 		 */
-
-		t = (d - (n.x * point->x + n.y * point->y + n.z * point->z)) /
-			 (n.x * (s->cop.x - point->x) +
-			  n.y * (s->cop.y - point->y) +
-			  n.z * (s->cop.z - point->z));
+		if (q->vertex >= 0 && face_has_vertex(s, f, q->vertex)) {
+			continue;
+		}
 
 		/* inter is the intersection point */
-		inter.x = (point->x + (t * (s->cop.x - point->x)));
-		inter.y = (point->y + (t * (s->cop.y - point->y)));
-		inter.z = (point->z + (t * (s->cop.z - point->z)));
-
+		inter.x = point->x + t[i] * r.x;
+		inter.y = point->y + t[i] * r.y;
+		inter.z = point->z + t[i] * r.z;
 
 		/*
 		 * if the intersection point isn't between the center of
@@ -310,11 +303,8 @@ occlude_point_convex(struct shape *s, point3 *point, struct edge *edge)
 			continue;
 		}
 
-		/*
-		 * if the intersection is not on a face, loop again to check
-		 * the next face
-		 */
-		if (!point_in_polygon(s, &inter, &(s->faces[i]), &n, d)) {
+		/* if the intersection is not on a face, check the next face */
+		if (!point_in_polygon(s, &inter, f)) {
 			continue;
 		}
 
@@ -330,3 +320,360 @@ occlude_point_convex(struct shape *s, point3 *point, struct edge *edge)
 
 	return 0;
 }
+
+/*
+ * occlusion method that works for convex shapes
+ *
+ * the ray between the center of projection and each point is only tested
+ * against the faces in the boxes of the bounding volume hierarchy it passes
+ * through, and the search stops at the first face that blocks it
+ *
+ * returns a mask with bit i set if point i should be occluded
+ */
+uint64_t
+occlude_block_convex(struct shape *s, struct point_block *b, struct edge *edge)
+{
+	int i, k;
+	uint64_t mask;
+	point3 p, *v;
+	struct occlude_query q;
+
+	/*
+	 * check specifically if the edge passed in is invalid (in the case
+	 * where the points being tested for occlusion are vertices)
+	 */
+	if (edge->edge[0] < 0 || edge->edge[1] < 0) {
+		return 0;
+	}
+
+	q.point = &p;
+	q.edge = edge;
+
+	mask = 0;
+	for (i = 0; i < b->n; ++i) {
+		p.x = b->x[i];
+		p.y = b->y[i];
+		p.z = b->z[i];
+
+		q.vertex = -1;
+		for (k = 0; k < 2; ++k) {
+			v = &(s->vertices[edge->edge[k]]);
+			if (p.x == v->x && p.y == v->y && p.z == v->z) {
+				q.vertex = edge->edge[k];
+			}
+		}
+
+		mask |= (uint64_t) bvh_segment(s, &p, &(s->cop), leaf_occludes,
+					       &q) << i;
+	}
+
+	return mask;
+}
+
+/*
+ * whether the n flattened vertices of a face make a convex polygon, which is
+ * when every corner turns the same way as the polygon goes around and the
+ * polygon only goes around once. Going around once means the edges change
+ * between going left and going right along u at most twice, which is what
+ * tells a pentagram apart from a pentagon
+ *
+ * returns 1 if the polygon is convex, else 0
+ */
+static
+int
+flat_convex(const double *fu, const double *fv, int n, double area)
+{
+	int k, dir, last, changes;
+	double du, dv, nu, nv;
+
+	if (area == 0) {
+		return 0;
+	}
+
+	last = 0;
+	changes = 0;
+	for (k = 0; k < n; ++k) {
+		du = fu[(k + 1) % n] - fu[k];
+		dv = fv[(k + 1) % n] - fv[k];
+		nu = fu[(k + 2) % n] - fu[(k + 1) % n];
+		nv = fv[(k + 2) % n] - fv[(k + 1) % n];
+
+		if ((du * nv - dv * nu) * area < 0) {
+			return 0;
+		}
+
+		dir = (du > 0) - (du < 0);
+		if (dir != 0) {
+			changes += last != 0 && dir != last;
+			last = dir;
+		}
+	}
+
+	/* the change from the last edge back to the first one */
+	for (k = 0; k < n; ++k) {
+		du = fu[(k + 1) % n] - fu[k];
+		dir = (du > 0) - (du < 0);
+		if (dir != 0) {
+			changes += dir != last;
+			break;
+		}
+	}
+
+	return changes <= 2;
+}
+
+/*
+ * flattens every face to 2D along the axis its normal is closest to, which
+ * keeps the polygon from collapsing, and finds the edge function of each of
+ * its edges in those coordinates
+ *
+ * the edge from p to q is a * u + b * v + c, the cross product of q - p and
+ * the point minus p. It's 0 on the edge and positive on the left of it, so if
+ * the polygon goes clockwise the signs are flipped to make the inside positive
+ *
+ * the flattened vertices are kept too, so faces that aren't convex are tested
+ * against them without flattening them again for every point. Faces of a
+ * convex solid are always convex, and the faces of other solids are checked
+ * here along with the rest, which is one more pass over their corners
+ *
+ * the plane of every face is also laid out for leaf_occludes()
+ */
+void
+project_faces(struct shape *s)
+{
+	int i, k, n, axis;
+	double pu, pv, qu, qv, area, sign;
+	double *a, *b, *c, *fu, *fv, *nx, *ny, *nz, *d;
+	point3 *nrm;
+	struct face *face;
+
+	n = s->num_he;
+	a = s->edge_fn;
+	b = s->edge_fn + n;
+	c = s->edge_fn + 2 * n;
+	fu = s->face_uv;
+	fv = s->face_uv + n;
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[i]);
+		nrm = &(s->normals[i]);
+
+		axis = 2;
+		if (fabs(nrm->x) > fabs(nrm->y) && fabs(nrm->x) > fabs(nrm->z)) {
+			axis = 0;
+		} else if (fabs(nrm->y) > fabs(nrm->z)) {
+			axis = 1;
+		}
+
+		face->axis = axis;
+
+		for (k = 0; k < face->num_v; ++k) {
+			flatten(&(s->vertices[face->face[k]]), axis,
+				&(fu[face->he + k]), &(fv[face->he + k]));
+		}
+
+		/* half edge k goes from vertex k to the next one */
+		area = 0;
+		for (k = 0; k < face->num_v; ++k) {
+			pu = fu[face->he + k];
+			pv = fv[face->he + k];
+			qu = fu[face->he + (k + 1) % face->num_v];
+			qv = fv[face->he + (k + 1) % face->num_v];
+
+			a[face->he + k] = pv - qv;
+			b[face->he + k] = qu - pu;
+			c[face->he + k] = (qv - pv) * pu - (qu - pu) * pv;
+
+			area += pu * qv - qu * pv;
+		}
+
+		sign = area < 0 ? -1 : 1;
+		for (k = 0; k < face->num_v; ++k) {
+			a[face->he + k] *= sign;
+			b[face->he + k] *= sign;
+			c[face->he + k] *= sign;
+		}
+
+		face->convex = s->convex ||
+			       flat_convex(&(fu[face->he]), &(fv[face->he]),
+					   face->num_v, area);
+	}
+
+	/* planes of the faces in the order of the leaves of the hierarchy */
+	nx = s->bvh_planes;
+	ny = nx + s->num_f;
+	nz = ny + s->num_f;
+	d = nz + s->num_f;
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[s->bvh_faces[i]]);
+		nrm = &(s->normals[s->bvh_faces[i]]);
+
+		nx[i] = nrm->x;
+		ny[i] = nrm->y;
+		nz[i] = nrm->z;
+		d[i] = vector3_dot(nrm, &(s->vertices[face->face[0]]));
+	}
+}
+
+/*
+ * finds which way each face normal points relative to the solid. For a convex
+ * solid the outside of a face is the side away from the centroid of the
+ * vertices
+ *
+ * the normals are recomputed from the same vertices after every transform,
+ * and rotating, scaling, and translating don't change which side of a face
+ * its normal is on, so this only has to be done once when the shape is loaded
+ */
+void
+orient_faces(struct shape *s)
+{
+	int i, k;
+	point3 c, fc, d;
+
+	c = (point3) {0, 0, 0};
+	for (i = 0; i < s->num_v; ++i) {
+		vector3_add(&c, &(s->vertices[i]), &c);
+	}
+
+	if (s->num_v > 0) {
+		vector3_mult(&c, 1.0 / s->num_v, &c);
+	}
+
+	for (i = 0; i < s->num_f; ++i) {
+		fc = (point3) {0, 0, 0};
+		for (k = 0; k < s->faces[i].num_v; ++k) {
+			vector3_add(&fc, &(s->vertices[s->faces[i].face[k]]), &fc);
+		}
+
+		vector3_mult(&fc, 1.0 / s->faces[i].num_v, &fc);
+		vector3_sub(&fc, &c, &d);
+
+		s->faces[i].outward =
+			vector3_dot(&(s->normals[i]), &d) < 0 ? -1 : 1;
+	}
+}
+
+/*
+ * whether the shape is a convex solid, which is when no vertex is in front of
+ * the outward side of any face that orient_faces() found. Only then is that
+ * side really the outside of every face, and only then is an edge seen
+ * exactly when one of its faces is
+ *
+ * every vertex is tested against every face, but only once when the shape is
+ * loaded, and the first vertex in front of a face ends it
+ *
+ * returns 1 if the shape is convex, else 0
+ */
+int
+check_convex(struct shape *s)
+{
+	int i, k;
+	double size, len;
+	point3 *p0, d;
+	struct face *face;
+
+	if (s->num_f == 0) {
+		return 0;
+	}
+
+	size = 0;
+	for (k = 0; k < s->num_v; ++k) {
+		size = fmax(size, fabs(s->vertices[k].x));
+		size = fmax(size, fabs(s->vertices[k].y));
+		size = fmax(size, fabs(s->vertices[k].z));
+	}
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[i]);
+		p0 = &(s->vertices[face->face[0]]);
+		len = vector3_mag(&(s->normals[i]));
+
+		for (k = 0; k < s->num_v; ++k) {
+			vector3_sub(&(s->vertices[k]), p0, &d);
+
+			if (face->outward * vector3_dot(&(s->normals[i]), &d) >
+			    CONVEX_EPSILON * size * len) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * labels an edge from which way its two faces face
+ */
+static
+void
+classify_edge(struct shape *s, struct edge *edge)
+{
+	int front0, front1;
+
+	front0 = edge->face[0] >= 0 && s->faces[edge->face[0]].front;
+	front1 = edge->face[1] >= 0 && s->faces[edge->face[1]].front;
+
+	if (front0 && front1) {
+		edge->side = EDGE_FRONT;
+	} else if (front0 || front1) {
+		edge->side = EDGE_SILHOUETTE;
+	} else {
+		edge->side = EDGE_BACK;
+	}
+}
+
+/*
+ * visibility of every edge of a convex solid, from which way its two faces
+ * face. A face faces the center of projection when its outward normal points
+ * towards it, which is one dot product per face. An edge of a convex solid is
+ * visible exactly when at least one of its faces faces the center of
+ * projection, so no point on an edge has to be tested against the faces
+ *
+ * the labels are kept from frame to frame, and only the edges around a face
+ * that turned towards or away from the center of projection are labeled
+ * again, found through the half edges of the face. Every edge is labeled when
+ * the labels aren't up to date (s->sides_valid is 0)
+ *
+ * a missing face (on the boundary of an open mesh) counts as facing away
+ */
+void
+classify_edges(struct shape *s)
+{
+	int i, k, front;
+	point3 v;
+	struct face *face;
+	struct half_edge *he;
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[i]);
+
+		vector3_sub(&(s->cop), &(s->vertices[face->face[0]]), &v);
+		front = face->outward * vector3_dot(&(s->normals[i]), &v) > 0;
+
+		if (front == face->front && s->sides_valid) {
+			continue;
+		}
+
+		face->front = front;
+
+		if (!s->sides_valid) {
+			continue;
+		}
+
+		for (k = 0; k < face->num_v; ++k) {
+			he = &(s->half_edges[face->he + k]);
+			if (he->edge >= 0) {
+				classify_edge(s, &(s->edges[he->edge]));
+			}
+		}
+	}
+
+	if (!s->sides_valid) {
+		for (i = 0; i < s->num_e; ++i) {
+			classify_edge(s, &(s->edges[i]));
+		}
+
+		s->sides_valid = 1;
+	}
+}
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "framebuffer.h"
+#include "term_shapes.h"
+
+/*
+ * allocate an empty framebuffer, which is sized on the first call to
+ * fb_resize()
+ *
+ * returns NULL if the allocation failed
+ */
+struct framebuffer *
+fb_create(void)
+{
+	struct framebuffer *fb;
+
+	fb = malloc(sizeof(struct framebuffer));
+	if (fb == NULL) {
+		return NULL;
+	}
+
+	fb->rows = 0;
+	fb->cols = 0;
+	fb->cells = NULL;
+	fb->shade = NULL;
+	fb->text = NULL;
+	fb->prev = NULL;
+	fb->line = NULL;
+
+	return fb;
+}
+
+/*
+ * make the framebuffer hold rows * cols cells. The cells are only reallocated
+ * when the dimensions change, so calling this every frame is cheap. After a
+ * change nothing is known about what's on the screen, so the next present
+ * redraws everything
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+int
+fb_resize(struct framebuffer *fb, int rows, int cols)
+{
+	uint16_t *cells;
+	uint8_t *shade, *text;
+	uint32_t *prev;
+	char *line;
+
+	if (rows < 0) {
+		rows = 0;
+	}
+
+	if (cols < 0) {
+		cols = 0;
+	}
+
+	if (fb->cells != NULL && fb->rows == rows && fb->cols == cols) {
+		return 0;
+	}
+
+	/* always allocate at least one cell so cells is never NULL */
+	cells = realloc(fb->cells, ((size_t) rows * cols + 1) * sizeof(*cells));
+	if (cells == NULL) {
+		return -1;
+	}
+
+	fb->cells = cells;
+
+	shade = realloc(fb->shade, (size_t) rows * cols + 1);
+	if (shade == NULL) {
+		/* cells may no longer fit the old dimensions */
+		fb->rows = 0;
+		fb->cols = 0;
+		return -1;
+	}
+
+	fb->shade = shade;
+
+	text = realloc(fb->text, (size_t) rows * cols + 1);
+	if (text == NULL) {
+		fb->rows = 0;
+		fb->cols = 0;
+		return -1;
+	}
+
+	fb->text = text;
+
+	prev = realloc(fb->prev, ((size_t) rows * cols + 1) * sizeof(*prev));
+	if (prev == NULL) {
+		fb->rows = 0;
+		fb->cols = 0;
+		return -1;
+	}
+
+	fb->prev = prev;
+
+	line = realloc(fb->line, (size_t) cols * FB_GLYPH_MAX + 1);
+	if (line == NULL) {
+		fb->rows = 0;
+		fb->cols = 0;
+		return -1;
+	}
+
+	fb->line = line;
+	fb->rows = rows;
+	fb->cols = cols;
+
+	fb_clear(fb);
+	fb_invalidate(fb);
+
+	return 0;
+}
+
+/*
+ * empty every cell in the framebuffer, and remove the text over it
+ */
+void
+fb_clear(struct framebuffer *fb)
+{
+	memset(fb->cells, 0, (size_t) fb->rows * fb->cols * sizeof(*fb->cells));
+	memset(fb->shade, 0, (size_t) fb->rows * fb->cols);
+	memset(fb->text, 0, (size_t) fb->rows * fb->cols);
+}
+
+/*
+ * forget what was presented, so every cell is redrawn by the next present
+ */
+void
+fb_invalidate(struct framebuffer *fb)
+{
+	/* FB_UNKNOWN has every bit set, so it can be written a byte at a time */
+	memset(fb->prev, 0xff, (size_t) fb->rows * fb->cols * sizeof(*fb->prev));
+}
+
+/*
+ * forget what was presented for len cells of a row starting at col, for when
+ * something other than the present stage writes to those positions
+ */
+void
+fb_invalidate_span(struct framebuffer *fb, int row, int col, int len)
+{
+	if (row < 0 || row >= fb->rows || col >= fb->cols) {
+		return;
+	}
+
+	if (col < 0) {
+		len += col;
+		col = 0;
+	}
+
+	if (col + len > fb->cols) {
+		len = fb->cols - col;
+	}
+
+	if (len > 0) {
+		memset(&(fb->prev[row * fb->cols + col]), 0xff,
+		       len * sizeof(*fb->prev));
+	}
+}
+
+/*
+ * free memory allocated for the framebuffer
+ */
+void
+fb_destroy(struct framebuffer *fb)
+{
+	if (fb == NULL) {
+		return;
+	}
+
+	free(fb->cells);
+	free(fb->shade);
+	free(fb->text);
+	free(fb->prev);
+	free(fb->line);
+	free(fb);
+}
+
+/*
+ * writes the character to print for either the front or behind dots of a cell
+ * (shifted down to the low byte) to out, and returns the number of bytes
+ * written
+ *
+ * in braille mode the dots are the offset of the character from U+2800, which
+ * is encoded in UTF-8 as 0xe2 0xa0-0xa3 0x80-0xbf
+ */
+int
+fb_glyph(uint8_t dots, enum pixel_mode mode, char *out)
+{
+	if (mode == BRAILLE) {
+		out[0] = (char) 0xe2;
+		out[1] = (char) (0xa0 | (dots >> 6));
+		out[2] = (char) (0x80 | (dots & 0x3f));
+		return 3;
+	}
+
+	if ((dots & FB_UPPER) && (dots & FB_LOWER)) {
+		out[0] = FULL;
+	} else if (dots & FB_UPPER) {
+		out[0] = UPPER;
+	} else {
+		out[0] = LOWER;
+	}
+
+	return 1;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "half_edge.h"
+#include "term_shapes.h"
+
+/* half edge sorted by the (unordered) pair of vertices it connects */
+struct he_key {
+	int v0; /* smaller vertex index */
+	int v1; /* larger vertex index */
+	int he;
+};
+
+static
+struct he_key
+make_key(int a, int b, int he)
+{
+	struct he_key k;
+
+	k.v0 = a < b ? a : b;
+	k.v1 = a < b ? b : a;
+	k.he = he;
+
+	return k;
+}
+
+static
+int
+cmp_key(const void *a, const void *b)
+{
+	const struct he_key *k0 = a;
+	const struct he_key *k1 = b;
+
+	if (k0->v0 != k1->v0) {
+		return k0->v0 < k1->v0 ? -1 : 1;
+	} else if (k0->v1 != k1->v1) {
+		return k0->v1 < k1->v1 ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/*
+ * builds the half edges of every face and links them to each other and to
+ * the edges of the shape, so the faces on either side of an edge can be
+ * looked up directly instead of searching every face for it
+ *
+ * half edges are matched up by sorting them on the pair of vertices they
+ * connect, so building them is O(H log H) for H half edges. It only has to be
+ * done once, since transforms move vertices but don't change which vertices
+ * are connected
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+int
+build_half_edges(struct shape *s)
+{
+	int i, k, n, base, same_way;
+	struct he_key *keys, key, *found;
+	struct half_edge *he;
+
+	n = 0;
+	for (i = 0; i < s->num_f; ++i) {
+		n += s->faces[i].num_v;
+	}
+
+	s->half_edges = malloc(sizeof(struct half_edge) * n + 1);
+	if (s->half_edges == NULL) {
+		return -1;
+	}
+
+	s->num_he = n;
+
+	keys = malloc(sizeof(struct he_key) * n + 1);
+	if (keys == NULL) {
+		free(s->half_edges);
+		return -1;
+	}
+
+	/* loop of half edges around each face */
+	base = 0;
+	for (i = 0; i < s->num_f; ++i) {
+		s->faces[i].he = base;
+
+		for (k = 0; k < s->faces[i].num_v; ++k) {
+			he = &(s->half_edges[base + k]);
+
+			he->origin = s->faces[i].face[k];
+			he->face = i;
+			he->next = base + (k + 1) % s->faces[i].num_v;
+			he->twin = -1;
+			he->edge = -1;
+
+			keys[base + k] = make_key(he->origin,
+				s->faces[i].face[(k + 1) % s->faces[i].num_v],
+				base + k);
+		}
+
+		base += s->faces[i].num_v;
+	}
+
+	qsort(keys, n, sizeof(struct he_key), cmp_key);
+
+	/*
+	 * two half edges connecting the same two vertices are twins. More than
+	 * two means more than two faces meet at the edge, and there's no way
+	 * to tell which of them are next to each other, so none are paired,
+	 * though they all still know their edge.
+	 * Twins going the same way mean the faces are wound differently, which
+	 * is fine since what's outside is worked out from the shape, but it's
+	 * logged in case the file has a mistake
+	 */
+	same_way = 0;
+	for (i = 0; i < n; i = k) {
+		for (k = i + 1; k < n && cmp_key(&(keys[i]), &(keys[k])) == 0;
+		     ++k) {
+		}
+
+		if (k - i > 2) {
+			fprintf(s->log,
+				"edge %d-%d is on %d faces, left unpaired\n",
+				keys[i].v0, keys[i].v1, k - i);
+			continue;
+		} else if (k - i < 2) {
+			continue;
+		}
+
+		he = &(s->half_edges[keys[i].he]);
+		he->twin = keys[i + 1].he;
+		s->half_edges[keys[i + 1].he].twin = keys[i].he;
+
+		if (s->half_edges[he->twin].origin == he->origin) {
+			same_way++;
+		}
+	}
+
+	if (same_way > 0) {
+		fprintf(s->log, "%d edges are between faces wound different ways\n",
+			same_way);
+	}
+
+	/* find the half edges, and so the faces, on each side of every edge */
+	for (i = 0; i < s->num_e; ++i) {
+		s->edges[i].face[0] = -1;
+		s->edges[i].face[1] = -1;
+		s->edges[i].num_faces = 0;
+
+		key = make_key(s->edges[i].edge[0], s->edges[i].edge[1], -1);
+		found = bsearch(&key, keys, n, sizeof(struct he_key), cmp_key);
+		if (found == NULL) {
+			continue;
+		}
+
+		he = &(s->half_edges[found->he]);
+		s->edges[i].face[0] = he->face;
+
+		if (he->twin >= 0) {
+			s->edges[i].face[1] = s->half_edges[he->twin].face;
+		}
+
+		/* every half edge along the edge, however many there are */
+		while (found > keys && cmp_key(found - 1, found) == 0) {
+			found--;
+		}
+
+		for (; found < keys + n && cmp_key(found, &key) == 0; ++found) {
+			s->half_edges[found->he].edge = i;
+			s->edges[i].num_faces++;
+		}
+	}
+
+	free(keys);
+
+	return 0;
+}
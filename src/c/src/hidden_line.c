@@ -0,0 +1,1669 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hidden_line.h"
+#include "half_edge.h"
+#include "print.h"
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * allocate empty state for ANALYTIC occlusion, which is sized on the first
+ * call to hl_prepare()
+ *
+ * returns NULL if the allocation failed
+ */
+struct hidden_line *
+hl_create(void)
+{
+	struct hidden_line *hl;
+
+	hl = malloc(sizeof(struct hidden_line));
+	if (hl == NULL) {
+		return NULL;
+	}
+
+	hl->faces = NULL;
+	hl->face_box = NULL;
+	hl->max_faces = 0;
+	hl->scratch = NULL;
+	hl->num_scratch = 0;
+	hl->tile_w = 1;
+	hl->tile_h = 1;
+	hl->tiles_x = 0;
+	hl->tiles_y = 0;
+	hl->face_bins = (struct tile_bins) {NULL, 0, NULL, 0};
+	hl->simple = -1;
+	hl->sil = NULL;
+	hl->sil_box = NULL;
+	hl->num_sil = 0;
+	hl->max_sil = 0;
+	hl->sil_bins = (struct tile_bins) {NULL, 0, NULL, 0};
+	hl->cache_first = NULL;
+	hl->cache_count = NULL;
+	hl->max_cache_edges = 0;
+	hl->cache = NULL;
+	hl->num_cache = 0;
+	hl->max_cache = 0;
+	hl->spare = NULL;
+	hl->max_spare = 0;
+	hl->cache_turns = 0;
+	hl->last_valid = 0;
+	hl->last_screen = NULL;
+	hl->max_last = 0;
+	hl->swept = NULL;
+	hl->num_swept = 0;
+	hl->max_swept = 0;
+	hl->swept_bins = (struct tile_bins) {NULL, 0, NULL, 0};
+
+	return hl;
+}
+
+/*
+ * range of tiles from min to max (in dots) along one axis of the screen,
+ * clamped to the screen
+ *
+ * returns 0 if the range misses the screen, else 1
+ */
+static
+int
+tile_range(double min, double max, int size, int tiles, int *t0, int *t1)
+{
+	if (max < 0 || min >= (double) size * tiles || min > max) {
+		return 0;
+	}
+
+	*t0 = min < 0 ? 0 : (int) (min / size);
+	*t1 = (int) (max / size);
+	*t1 = *t1 >= tiles ? tiles - 1 : *t1;
+
+	return 1;
+}
+
+/*
+ * sizes the tiles for the frame. With few faces the whole screen is one tile
+ */
+static
+void
+size_tiles(struct shape *s)
+{
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	if (s->num_f < HL_TILE_MIN_FACES) {
+		hl->tile_w = (s->view.cols > 0 ? s->view.cols : 1) * s->view.dots_x;
+		hl->tile_h = (s->view.rows > 0 ? s->view.rows : 1) * s->view.dots_y;
+		hl->tiles_x = 1;
+		hl->tiles_y = 1;
+	} else {
+		hl->tile_w = HL_TILE * s->view.dots_x;
+		hl->tile_h = HL_TILE * s->view.dots_y;
+		hl->tiles_x = (s->view.cols + HL_TILE - 1) / HL_TILE;
+		hl->tiles_y = (s->view.rows + HL_TILE - 1) / HL_TILE;
+	}
+}
+
+/*
+ * records each of n boxes in every tile of the screen it overlaps, so a query
+ * only has to look at the boxes of the tiles it touches. The bins are counted,
+ * then filled, in flat arrays that are reused from frame to frame
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+bin_boxes(struct hidden_line *hl, struct hl_box *box, int n,
+	  struct tile_bins *bins)
+{
+	int i, x, y, x0, x1, y0, y1, tiles, *start, *items;
+
+	tiles = hl->tiles_x * hl->tiles_y;
+
+	if (tiles + 1 > bins->max_start) {
+		start = realloc(bins->start, sizeof(int) * (tiles + 1));
+		if (start == NULL) {
+			return -1;
+		}
+
+		bins->start = start;
+		bins->max_start = tiles + 1;
+	}
+
+	start = bins->start;
+	memset(start, 0, sizeof(int) * (tiles + 1));
+
+	/* count the boxes of each tile into the slot after it */
+	for (i = 0; i < n; ++i) {
+		if (!tile_range(box[i].min_x, box[i].max_x, hl->tile_w,
+				hl->tiles_x, &x0, &x1) ||
+		    !tile_range(box[i].min_y, box[i].max_y, hl->tile_h,
+				hl->tiles_y, &y0, &y1)) {
+			continue;
+		}
+
+		for (y = y0; y <= y1; ++y) {
+			for (x = x0; x <= x1; ++x) {
+				start[y * hl->tiles_x + x + 1]++;
+			}
+		}
+	}
+
+	for (i = 0; i < tiles; ++i) {
+		start[i + 1] += start[i];
+	}
+
+	if (start[tiles] > bins->max_items) {
+		items = realloc(bins->items, sizeof(int) * start[tiles]);
+		if (items == NULL) {
+			return -1;
+		}
+
+		bins->items = items;
+		bins->max_items = start[tiles];
+	}
+
+	/*
+	 * fill the bins, using the start of each tile as where its next box
+	 * goes, which leaves it at the start of the next tile
+	 */
+	for (i = 0; i < n; ++i) {
+		if (!tile_range(box[i].min_x, box[i].max_x, hl->tile_w,
+				hl->tiles_x, &x0, &x1) ||
+		    !tile_range(box[i].min_y, box[i].max_y, hl->tile_h,
+				hl->tiles_y, &y0, &y1)) {
+			continue;
+		}
+
+		for (y = y0; y <= y1; ++y) {
+			for (x = x0; x <= x1; ++x) {
+				bins->items[start[y * hl->tiles_x + x]++] = i;
+			}
+		}
+	}
+
+	for (i = tiles; i > 0; --i) {
+		start[i] = start[i - 1];
+	}
+	start[0] = 0;
+
+	return 0;
+}
+
+/*
+ * makes room to cache the hidden intervals of every edge, to remember where
+ * every vertex was on the screen, and for what swept across it. Nothing is
+ * cached, and the last frame isn't known, after either of the first two grow
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+cache_alloc(struct shape *s)
+{
+	int i, *first, *count;
+	point3 *last;
+	struct hl_box *box;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	if (s->num_e > hl->max_cache_edges) {
+		first = realloc(hl->cache_first, sizeof(int) * s->num_e);
+		if (first == NULL) {
+			return -1;
+		}
+
+		hl->cache_first = first;
+
+		count = realloc(hl->cache_count, sizeof(int) * s->num_e);
+		if (count == NULL) {
+			return -1;
+		}
+
+		hl->cache_count = count;
+		hl->max_cache_edges = s->num_e;
+
+		for (i = 0; i < s->num_e; ++i) {
+			hl->cache_count[i] = -1;
+		}
+
+		hl->num_cache = 0;
+	}
+
+	if (s->num_v > hl->max_last) {
+		last = realloc(hl->last_screen, sizeof(point3) * s->num_v);
+		if (last == NULL) {
+			return -1;
+		}
+
+		hl->last_screen = last;
+		hl->max_last = s->num_v;
+		hl->last_valid = 0;
+	}
+
+	if (s->num_he + s->num_f > hl->max_swept) {
+		box = realloc(hl->swept,
+			      sizeof(struct hl_box) * (s->num_he + s->num_f));
+		if (box == NULL) {
+			return -1;
+		}
+
+		hl->swept = box;
+		hl->max_swept = s->num_he + s->num_f;
+	}
+
+	return 0;
+}
+
+/*
+ * how far a point of the shape can stray from the line between where it was
+ * on the screen at the last frame and where it is now, in dots, when only the
+ * rotation of the model changed since. However many turns there were, the
+ * model got from one rotation to the other by turning around one axis
+ * through its center, which moves every point along an arc of a circle
+ * around the axis. An arc of angle a bulges out from its chord by
+ * r * (1 - cos(a / 2)) for a circle of radius r, and no point is further
+ * from the center than the furthest vertex
+ *
+ * the shape as it's loaded is usually lined up with the axes. Looking down
+ * its z axis, edges at the back can lie exactly behind those at the front,
+ * where whether they're hidden is a toss up that turning settles, so nothing
+ * found there is kept
+ *
+ * returns the distance, or -1 if the shape was scaled or moved, the viewport
+ * changed, there's no last frame, or it looked down the z axis of the model
+ */
+static
+double
+turn_bulge(struct shape *s)
+{
+	int i, k;
+	double c, r, scale;
+	point3 d;
+	struct viewport *v, *last;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	v = &(s->view);
+	last = &(hl->last_view);
+
+	if (!hl->last_valid || hl->last_model.rot[2][2] == 1 ||
+	    s->model.scale != hl->last_model.scale ||
+	    s->center.x != hl->last_center.x ||
+	    s->center.y != hl->last_center.y ||
+	    s->center.z != hl->last_center.z ||
+	    v->rows != last->rows || v->cols != last->cols ||
+	    v->dots_x != last->dots_x || v->dots_y != last->dots_y) {
+		return -1;
+	}
+
+	/* the trace of rot * last rot^T is 1 + 2 cos(a) */
+	c = 0;
+	for (i = 0; i < 3; ++i) {
+		for (k = 0; k < 3; ++k) {
+			c += s->model.rot[i][k] * hl->last_model.rot[i][k];
+		}
+	}
+
+	c = (c - 1) / 2;
+	c = c > 1 ? 1 : (c < -1 ? -1 : c);
+
+	r = 0;
+	for (i = 0; i < s->num_v; ++i) {
+		vector3_sub(&(s->vertices[i]), &(s->center), &d);
+		r = fmax(r, vector3_dot(&d, &d));
+	}
+
+	scale = fmax(fabs(v->scale_x), fabs(v->scale_y));
+
+	return sqrt(r) * scale * (1 - sqrt((1 + c) / 2));
+}
+
+/*
+ * the bounding box of where the n vertices idx moved through on the screen
+ * since the last frame, grown by pad on every side
+ */
+static
+void
+swept_box(struct shape *s, int *idx, int n, double pad, struct hl_box *box)
+{
+	int i;
+	point3 *p, *q;
+
+	p = &(s->hl->last_screen[idx[0]]);
+	box->min_x = box->max_x = p->x;
+	box->min_y = box->max_y = p->y;
+
+	for (i = 0; i < n; ++i) {
+		p = &(s->hl->last_screen[idx[i]]);
+		q = &(s->screen[idx[i]]);
+
+		box->min_x = fmin(box->min_x, fmin(p->x, q->x));
+		box->max_x = fmax(box->max_x, fmax(p->x, q->x));
+		box->min_y = fmin(box->min_y, fmin(p->y, q->y));
+		box->max_y = fmax(box->max_y, fmax(p->y, q->y));
+	}
+
+	box->min_x -= pad;
+	box->max_x += pad;
+	box->min_y -= pad;
+	box->max_y += pad;
+}
+
+/*
+ * whether a box overlaps anything that swept across the screen, or isn't
+ * entirely on the screen. Only the boxes in the tiles it overlaps are tested
+ *
+ * returns 1 if it does, else 0
+ */
+static
+int
+swept_over(struct hidden_line *hl, struct hl_box *box)
+{
+	int i, x, y, x0, x1, y0, y1, *tile;
+	struct hl_box *b;
+
+	if (box->min_x < 0 || box->max_x >= (double) hl->tile_w * hl->tiles_x ||
+	    box->min_y < 0 || box->max_y >= (double) hl->tile_h * hl->tiles_y) {
+		return 1;
+	}
+
+	tile_range(box->min_x, box->max_x, hl->tile_w, hl->tiles_x, &x0, &x1);
+	tile_range(box->min_y, box->max_y, hl->tile_h, hl->tiles_y, &y0, &y1);
+
+	for (y = y0; y <= y1; ++y) {
+		for (x = x0; x <= x1; ++x) {
+			tile = &(hl->swept_bins.start[y * hl->tiles_x + x]);
+
+			for (i = tile[0]; i < tile[1]; ++i) {
+				b = &(hl->swept[hl->swept_bins.items[i]]);
+
+				if (b->max_x >= box->min_x &&
+				    b->min_x <= box->max_x &&
+				    b->max_y >= box->min_y &&
+				    b->min_y <= box->max_y) {
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * drops the hidden intervals of every edge from the cache
+ */
+static
+void
+drop_edges(struct shape *s)
+{
+	int i;
+
+	for (i = 0; i < s->num_e; ++i) {
+		s->hl->cache_count[i] = -1;
+	}
+
+	s->hl->num_cache = 0;
+}
+
+/*
+ * after the shape turned, keeps the hidden intervals of the edges nothing
+ * moved across. On a surface that doesn't cross itself, a point is only
+ * hidden by something else once a silhouette in front of it passes over it
+ * on the screen, so whether a point changed from hidden to seen or back can
+ * only change where a silhouette swept, or where a face turned over and the
+ * silhouettes around it came or went. Boxes around where those went are
+ * binned by tile, and an edge is kept if it wasn't PARTIAL and the box it
+ * swept doesn't overlap any of the boxes in the dirty tiles it's in. Where
+ * along a PARTIAL edge it's hidden moves with the silhouettes in front of it,
+ * so those are always found again. The intervals kept are copied together,
+ * so the cache doesn't fill up with those of edges that were dropped
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+keep_edges(struct shape *s, double pad)
+{
+	int i, n, count, max;
+	struct interval *h, *spare;
+	struct hl_box box;
+	struct edge *edge;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	if (hl->num_cache > hl->max_spare) {
+		max = hl->max_cache;
+
+		spare = realloc(hl->spare, sizeof(struct interval) * max);
+		if (spare == NULL) {
+			return -1;
+		}
+
+		hl->spare = spare;
+		hl->max_spare = max;
+	}
+
+	n = 0;
+	for (i = 0; i < s->num_e; ++i) {
+		count = hl->cache_count[i];
+		if (count < 0) {
+			continue;
+		}
+
+		edge = &(s->edges[i]);
+		h = &(hl->cache[hl->cache_first[i]]);
+
+		/* PARTIAL, as edge_occlusion_state() tells it */
+		if (count > 1 ||
+		    (count == 1 && (h->start > 0 || h->end < 1))) {
+			hl->cache_count[i] = -1;
+			continue;
+		}
+
+		swept_box(s, edge->edge, 2, pad, &box);
+		if (swept_over(hl, &box)) {
+			hl->cache_count[i] = -1;
+			continue;
+		}
+
+		if (count > 0) {
+			memcpy(&(hl->spare[n]), h, sizeof(struct interval) * count);
+		}
+
+		hl->cache_first[i] = n;
+		n += count;
+	}
+
+	/* the cache and the spare trade places */
+	spare = hl->spare;
+	max = hl->max_spare;
+	hl->spare = hl->cache;
+	hl->max_spare = hl->max_cache;
+	hl->cache = spare;
+	hl->max_cache = max;
+	hl->num_cache = n;
+
+	return 0;
+}
+
+/*
+ * adds where the silhouettes of the frame swept since the last frame to the
+ * boxes of what swept across the screen
+ */
+static
+void
+sweep_silhouettes(struct shape *s, double pad)
+{
+	int i, idx[2];
+	struct half_edge *he;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	for (i = 0; i < hl->num_sil; ++i) {
+		he = &(s->half_edges[hl->sil[i]]);
+		idx[0] = he->origin;
+		idx[1] = s->half_edges[he->next].origin;
+
+		swept_box(s, idx, 2, pad, &(hl->swept[hl->num_swept++]));
+	}
+}
+
+/*
+ * remembers where the shape and its vertices were for the next frame
+ */
+static
+void
+remember_frame(struct shape *s)
+{
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	memcpy(hl->last_screen, s->screen, sizeof(point3) * s->num_v);
+	hl->last_model = s->model;
+	hl->last_center = s->center;
+	hl->last_view = s->view;
+	hl->last_valid = 1;
+	hl->cache_turns = s->turns;
+}
+
+/*
+ * which side of the line through p and q the point r is on, in 2D: positive
+ * on the left, negative on the right, 0 on the line
+ */
+static inline
+double
+side(double px, double py, double qx, double qy, double rx, double ry)
+{
+	return (qx - px) * (ry - py) - (qy - py) * (rx - px);
+}
+
+/*
+ * whether any face crosses itself, like the pentagrams of a star polyhedron.
+ * Each face is flattened along the axis its normal is closest to and every
+ * pair of its edges that don't share a vertex is tested for crossing. Faces
+ * only turn, move, and scale with the shape, so this is only done once
+ *
+ * returns 1 if every face is a simple polygon, else 0
+ */
+static
+int
+check_simple(struct shape *s)
+{
+	int f, i, k, n, axis;
+	double d0, d1, d2, d3;
+	double u[4], v[4];
+	point3 *nrm, *p;
+	struct face *face;
+
+	for (f = 0; f < s->num_f; ++f) {
+		face = &(s->faces[f]);
+		nrm = &(s->normals[f]);
+		n = face->num_v;
+
+		axis = 2;
+		if (fabs(nrm->x) > fabs(nrm->y) && fabs(nrm->x) > fabs(nrm->z)) {
+			axis = 0;
+		} else if (fabs(nrm->y) > fabs(nrm->z)) {
+			axis = 1;
+		}
+
+		for (i = 0; i < n; ++i) {
+			for (k = i + 2; k < n; ++k) {
+				/* the last edge shares a vertex with the first */
+				if (i == 0 && k == n - 1) {
+					continue;
+				}
+
+				p = &(s->vertices[face->face[i]]);
+				u[0] = axis == 0 ? p->y : p->x;
+				v[0] = axis == 2 ? p->y : p->z;
+				p = &(s->vertices[face->face[i + 1]]);
+				u[1] = axis == 0 ? p->y : p->x;
+				v[1] = axis == 2 ? p->y : p->z;
+				p = &(s->vertices[face->face[k]]);
+				u[2] = axis == 0 ? p->y : p->x;
+				v[2] = axis == 2 ? p->y : p->z;
+				p = &(s->vertices[face->face[(k + 1) % n]]);
+				u[3] = axis == 0 ? p->y : p->x;
+				v[3] = axis == 2 ? p->y : p->z;
+
+				d0 = side(u[0], v[0], u[1], v[1], u[2], v[2]);
+				d1 = side(u[0], v[0], u[1], v[1], u[3], v[3]);
+				d2 = side(u[2], v[2], u[3], v[3], u[0], v[0]);
+				d3 = side(u[2], v[2], u[3], v[3], u[1], v[1]);
+
+				if (((d0 < 0 && d1 > 0) || (d0 > 0 && d1 < 0)) &&
+				    ((d2 < 0 && d3 > 0) || (d2 > 0 && d3 < 0))) {
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * makes room in the scratch of a thread for the faces and half edges of the
+ * shape, and for n cuts along an edge
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+scratch_alloc(struct shape *s, struct hl_scratch *sc, int n)
+{
+	int *seen;
+	double *t;
+
+	if (s->num_f > sc->max_seen) {
+		seen = realloc(sc->seen, sizeof(int) * s->num_f);
+		if (seen == NULL) {
+			return -1;
+		}
+
+		sc->seen = seen;
+		sc->max_seen = s->num_f;
+
+		memset(sc->seen, 0, sizeof(int) * sc->max_seen);
+		memset(sc->sil_seen, 0, sizeof(int) * sc->max_sil_seen);
+		sc->stamp = 0;
+	}
+
+	if (s->hl->simple && s->num_he > sc->max_sil_seen) {
+		seen = realloc(sc->sil_seen, sizeof(int) * s->num_he);
+		if (seen == NULL) {
+			return -1;
+		}
+
+		sc->sil_seen = seen;
+		sc->max_sil_seen = s->num_he;
+
+		memset(sc->seen, 0, sizeof(int) * sc->max_seen);
+		memset(sc->sil_seen, 0, sizeof(int) * sc->max_sil_seen);
+		sc->stamp = 0;
+	}
+
+	if (n > sc->max_t) {
+		t = realloc(sc->t, sizeof(double) * n);
+		if (t == NULL) {
+			return -1;
+		}
+
+		sc->t = t;
+		sc->max_t = n;
+	}
+
+	return 0;
+}
+
+/*
+ * makes room for the things that only depend on the number of faces and half
+ * edges, which don't change after the shape is loaded, with scratch for
+ * every thread of the shape
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+hl_alloc(struct shape *s)
+{
+	int i, n, max_v, threads, *sil;
+	struct hl_face *faces;
+	struct hl_box *box;
+	struct hl_scratch *scratch;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	if (s->num_f > hl->max_faces) {
+		faces = realloc(hl->faces, sizeof(struct hl_face) * s->num_f);
+		if (faces == NULL) {
+			return -1;
+		}
+
+		hl->faces = faces;
+
+		box = realloc(hl->face_box, sizeof(struct hl_box) * s->num_f);
+		if (box == NULL) {
+			return -1;
+		}
+
+		hl->face_box = box;
+		hl->max_faces = s->num_f;
+	}
+
+	if (hl->simple && s->num_he > hl->max_sil) {
+		sil = realloc(hl->sil, sizeof(int) * s->num_he);
+		if (sil == NULL) {
+			return -1;
+		}
+
+		hl->sil = sil;
+
+		box = realloc(hl->sil_box, sizeof(struct hl_box) * s->num_he);
+		if (box == NULL) {
+			return -1;
+		}
+
+		hl->sil_box = box;
+		hl->max_sil = s->num_he;
+	}
+
+	threads = s->threads > 1 ? s->threads : 1;
+	if (threads > hl->num_scratch) {
+		scratch = realloc(hl->scratch, sizeof(struct hl_scratch) * threads);
+		if (scratch == NULL) {
+			return -1;
+		}
+
+		hl->scratch = scratch;
+
+		for (i = hl->num_scratch; i < threads; ++i) {
+			hl->scratch[i] = (struct hl_scratch) {
+				NULL, 0, 0, NULL, 0, NULL, 0, NULL, 0, 0
+			};
+		}
+
+		hl->num_scratch = threads;
+	}
+
+	/*
+	 * an edge crosses a face at most once per edge of the face, plus once
+	 * where it goes through the plane of the face, plus its two ends. With
+	 * silhouettes it's cut at most once per half edge
+	 */
+	max_v = 0;
+	for (i = 0; i < s->num_f; ++i) {
+		max_v = s->faces[i].num_v > max_v ? s->faces[i].num_v : max_v;
+	}
+
+	n = max_v + 3;
+	if (hl->simple && s->num_he + 2 > n) {
+		n = s->num_he + 2;
+	}
+
+	for (i = 0; i < hl->num_scratch; ++i) {
+		if (scratch_alloc(s, &(hl->scratch[i]), n) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * finds the half edges on the silhouette for the frame. The two faces of an
+ * edge go around it in opposite directions if they're wound the same way, so
+ * the edge is on the silhouette if they go around the screen in different
+ * directions, or in the same direction if they're wound differently. Half
+ * edges without a twin are on the boundary of the mesh, where the surface
+ * ends, so they count as silhouettes too
+ */
+static
+void
+find_silhouettes(struct shape *s)
+{
+	int i, twin, same_way, ccw0, ccw1;
+	point3 *p, *q;
+	struct half_edge *he;
+	struct hl_box *box;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	hl->num_sil = 0;
+
+	for (i = 0; i < s->num_he; ++i) {
+		he = &(s->half_edges[i]);
+		twin = he->twin;
+
+		/* each edge is looked at from one of its half edges */
+		if (twin >= 0 && twin < i) {
+			continue;
+		}
+
+		if (twin >= 0) {
+			ccw0 = hl->faces[he->face].ccw;
+			ccw1 = hl->faces[s->half_edges[twin].face].ccw;
+			same_way = s->half_edges[twin].origin != he->origin;
+
+			if (same_way ? ccw0 == ccw1 : ccw0 != ccw1) {
+				continue;
+			}
+		}
+
+		p = &(s->screen[he->origin]);
+		q = &(s->screen[s->half_edges[he->next].origin]);
+
+		box = &(hl->sil_box[hl->num_sil]);
+		box->min_x = fmin(p->x, q->x);
+		box->max_x = fmax(p->x, q->x);
+		box->min_y = fmin(p->y, q->y);
+		box->max_y = fmax(p->y, q->y);
+
+		hl->sil[hl->num_sil++] = i;
+	}
+}
+
+/*
+ * finds where every face is on the screen and the plane its depth is on, from
+ * the vertices projected for the frame, and bins the faces (and silhouettes,
+ * for simple shapes) by screen tile
+ *
+ * the cache of hidden intervals is kept if the shape didn't turn in depth.
+ * If it did, a simple shape that only turned keeps the edges nothing moved
+ * across. A face turned over when it goes around the screen the other way
+ * than at the last frame, which is the same test classify_edges() does for
+ * CONVEX occlusion, but on the projection the edges are drawn with. Every
+ * face hides edges on a shape that isn't simple, and every face moves when it
+ * turns, so the whole cache is emptied then
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+int
+hl_prepare(struct shape *s)
+{
+	int i, k, ccw;
+	double area, pad;
+	struct hl_face *hf;
+	struct hl_box *box;
+	struct face *face;
+	struct hidden_line *hl;
+	point3 *p0, *p1, *p2, *p, *q, e0, e1, m;
+
+	hl = s->hl;
+
+	if (hl->simple < 0) {
+		hl->simple = check_simple(s);
+	}
+
+	if (hl_alloc(s) != 0 || cache_alloc(s) != 0) {
+		return -1;
+	}
+
+	/* how far off the line between frames a point can be, -1 if unknown */
+	pad = -1;
+	if (hl->cache_turns != s->turns && hl->simple) {
+		pad = turn_bulge(s);
+	}
+
+	if (pad >= 0) {
+		pad += HL_EPSILON;
+	}
+
+	hl->num_swept = 0;
+
+	for (i = 0; i < s->num_f; ++i) {
+		face = &(s->faces[i]);
+		hf = &(hl->faces[i]);
+		box = &(hl->face_box[i]);
+
+		/* nothing is binned for an empty box */
+		hf->flat = 1;
+		box->min_x = 1;
+		box->max_x = 0;
+
+		if (face->num_v < 3) {
+			hf->ccw = 0;
+			continue;
+		}
+
+		/* which way the face goes around the screen (shoelace) */
+		area = 0;
+		p = &(s->screen[face->face[face->num_v - 1]]);
+		for (k = 0; k < face->num_v; ++k) {
+			q = &(s->screen[face->face[k]]);
+			area += p->x * q->y - q->x * p->y;
+			p = q;
+		}
+
+		ccw = area > 0;
+
+		if (pad >= 0 && ccw != hf->ccw) {
+			swept_box(s, face->face, face->num_v, pad,
+				  &(hl->swept[hl->num_swept++]));
+		}
+
+		hf->ccw = ccw;
+
+		/* plane through the first three vertices in dot coordinates */
+		p0 = &(s->screen[face->face[0]]);
+		p1 = &(s->screen[face->face[1]]);
+		p2 = &(s->screen[face->face[2]]);
+
+		vector3_sub(p1, p0, &e0);
+		vector3_sub(p2, p0, &e1);
+		vector3_cross(&e0, &e1, &m);
+
+		if (fabs(m.z) < 1e-9) {
+			continue;
+		}
+
+		hf->flat = 0;
+		hf->dzdx = -m.x / m.z;
+		hf->dzdy = -m.y / m.z;
+		hf->z0 = p0->z - p0->x * hf->dzdx - p0->y * hf->dzdy;
+
+		box->min_x = box->max_x = p0->x;
+		box->min_y = box->max_y = p0->y;
+		hf->max_z = p0->z;
+		for (k = 1; k < face->num_v; ++k) {
+			p = &(s->screen[face->face[k]]);
+
+			box->min_x = fmin(box->min_x, p->x);
+			box->max_x = fmax(box->max_x, p->x);
+			box->min_y = fmin(box->min_y, p->y);
+			box->max_y = fmax(box->max_y, p->y);
+			hf->max_z = fmax(hf->max_z, p->z);
+		}
+	}
+
+	size_tiles(s);
+
+	if (bin_boxes(hl, hl->face_box, s->num_f, &(hl->face_bins)) != 0) {
+		return -1;
+	}
+
+	if (hl->simple) {
+		find_silhouettes(s);
+
+		if (bin_boxes(hl, hl->sil_box, hl->num_sil,
+			      &(hl->sil_bins)) != 0) {
+			return -1;
+		}
+	}
+
+	if (pad >= 0) {
+		sweep_silhouettes(s, pad);
+
+		if (bin_boxes(hl, hl->swept, hl->num_swept,
+			      &(hl->swept_bins)) != 0 ||
+		    keep_edges(s, pad) != 0) {
+			return -1;
+		}
+	} else if (hl->cache_turns != s->turns) {
+		drop_edges(s);
+	}
+
+	remember_frame(s);
+
+	return 0;
+}
+
+/*
+ * whether the point (x, y) on the screen is inside of the projection of a
+ * face, by the even-odd rule so faces that aren't convex or that cross
+ * themselves, like pentagrams, work too
+ *
+ * returns 1 if the point is inside, and 0 if not
+ */
+static
+int
+inside_face(struct shape *s, struct face *face, double x, double y)
+{
+	int i, inside;
+	point3 *a, *b;
+
+	inside = 0;
+	a = &(s->screen[face->face[face->num_v - 1]]);
+	for (i = 0; i < face->num_v; ++i) {
+		b = &(s->screen[face->face[i]]);
+
+		if ((a->y <= y) != (b->y <= y) &&
+		    x < a->x + (y - a->y) * (b->x - a->x) / (b->y - a->y)) {
+			inside = !inside;
+		}
+
+		a = b;
+	}
+
+	return inside;
+}
+
+/*
+ * depth of a face at the point (x, y) on the screen
+ */
+static inline
+double
+face_depth(struct hl_face *hf, double x, double y)
+{
+	return hf->z0 + x * hf->dzdx + y * hf->dzdy;
+}
+
+/*
+ * whether a face is in front of the point p (in dot coordinates) on the
+ * screen
+ *
+ * returns 1 if the face covers p, else 0
+ */
+static
+int
+face_covers(struct shape *s, int f, point3 *p)
+{
+	struct hl_face *hf;
+	struct hl_box *box;
+
+	hf = &(s->hl->faces[f]);
+	box = &(s->hl->face_box[f]);
+
+	if (hf->flat ||
+	    p->x < box->min_x || p->x > box->max_x ||
+	    p->y < box->min_y || p->y > box->max_y ||
+	    hf->max_z <= p->z + HL_EPSILON) {
+		return 0;
+	}
+
+	return face_depth(hf, p->x, p->y) - p->z > HL_EPSILON &&
+	       inside_face(s, &(s->faces[f]), p->x, p->y);
+}
+
+/*
+ * whether any face other than the ones the edge is on is in front of the point
+ * p (in dot coordinates) on the screen. edge is NULL if p isn't on an edge
+ *
+ * only the faces binned in the tile of the point can cover it. Faces off the
+ * screen aren't binned, so points off the screen are tested against every
+ * face
+ *
+ * returns 1 if p is covered, else 0
+ */
+static
+int
+covered(struct shape *s, point3 *p, struct edge *edge)
+{
+	int i, f, x, y;
+	struct tile_bins *bins;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	bins = &(hl->face_bins);
+
+	if (!tile_range(p->x, p->x, hl->tile_w, hl->tiles_x, &x, &x) ||
+	    !tile_range(p->y, p->y, hl->tile_h, hl->tiles_y, &y, &y)) {
+		for (i = 0; i < s->num_f; ++i) {
+			if ((edge == NULL || !edge_on_face(s, edge, i)) &&
+			    face_covers(s, i, p)) {
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	y = y * hl->tiles_x + x;
+	for (i = bins->start[y]; i < bins->start[y + 1]; ++i) {
+		f = bins->items[i];
+		if ((edge == NULL || !edge_on_face(s, edge, f)) &&
+		    face_covers(s, f, p)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * makes room for n hidden intervals
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+static
+int
+reserve_hidden(struct hl_scratch *sc, int n)
+{
+	int max;
+	struct interval *hidden;
+
+	if (n <= sc->max_hidden) {
+		return 0;
+	}
+
+	max = sc->max_hidden ? 2 * sc->max_hidden : 16;
+	max = max < n ? n : max;
+
+	hidden = realloc(sc->hidden, sizeof(struct interval) * max);
+	if (hidden == NULL) {
+		return -1;
+	}
+
+	sc->hidden = hidden;
+	sc->max_hidden = max;
+
+	return 0;
+}
+
+/*
+ * adds an interval to the hidden intervals of the edge
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+static
+int
+add_hidden(struct hl_scratch *sc, double start, double end)
+{
+	if (reserve_hidden(sc, sc->num_hidden + 1) != 0) {
+		return -1;
+	}
+
+	sc->hidden[sc->num_hidden].start = start;
+	sc->hidden[sc->num_hidden].end = end;
+	sc->num_hidden++;
+
+	return 0;
+}
+
+/*
+ * compares intervals by where they start, for qsort()
+ */
+static
+int
+cmp_interval(const void *a, const void *b)
+{
+	const struct interval *ia, *ib;
+
+	ia = a;
+	ib = b;
+
+	return (ia->start > ib->start) - (ia->start < ib->start);
+}
+
+/*
+ * sorts the hidden intervals and merges those that overlap or touch, like
+ * those of adjacent faces
+ */
+static
+void
+merge_hidden(struct hl_scratch *sc)
+{
+	int i, n;
+
+	if (sc->num_hidden < 2) {
+		return;
+	}
+
+	qsort(sc->hidden, sc->num_hidden, sizeof(struct interval), cmp_interval);
+
+	n = 0;
+	for (i = 1; i < sc->num_hidden; ++i) {
+		if (sc->hidden[i].start <= sc->hidden[n].end) {
+			sc->hidden[n].end = fmax(sc->hidden[n].end,
+						 sc->hidden[i].end);
+		} else {
+			sc->hidden[++n] = sc->hidden[i];
+		}
+	}
+
+	sc->num_hidden = n + 1;
+}
+
+/*
+ * insertion sort of the cuts along an edge, of which there are only a few
+ */
+static
+void
+sort_cuts(double *cut, int n)
+{
+	int i, k;
+	double tmp;
+
+	for (i = 1; i < n; ++i) {
+		tmp = cut[i];
+		for (k = i; k > 0 && cut[k - 1] > tmp; --k) {
+			cut[k] = cut[k - 1];
+		}
+		cut[k] = tmp;
+	}
+}
+
+/*
+ * where the segment a, b crosses the segment p, q on the screen, as the
+ * parameters t along a, b and u along p, q, solving
+ * a + t * (b - a) = p + u * (q - p) with 2D cross products
+ *
+ * returns 0 if the segments are parallel, else 1
+ */
+static inline
+int
+crossing(point3 *a, point3 *b, point3 *p, point3 *q, double *t, double *u)
+{
+	double dx, dy, ex, ey, denom;
+
+	dx = b->x - a->x;
+	dy = b->y - a->y;
+	ex = q->x - p->x;
+	ey = q->y - p->y;
+	denom = dx * ey - dy * ex;
+
+	if (denom == 0) {
+		return 0;
+	}
+
+	*t = ((p->x - a->x) * ey - (p->y - a->y) * ex) / denom;
+	*u = ((p->x - a->x) * dy - (p->y - a->y) * dx) / denom;
+
+	return 1;
+}
+
+/*
+ * finds the intervals of an edge hidden by one face
+ *
+ * the edge is cut at every point where, on the screen, it crosses an edge of
+ * the face, and where it goes through the plane of the face. Between two cuts
+ * the edge is either entirely inside or entirely outside of the face and
+ * entirely in front of or behind it, so the piece is tested at its middle
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+hide_by_face(struct shape *s, struct hl_scratch *sc, struct hl_face *hf,
+	     struct face *face, point3 *a, point3 *b)
+{
+	int i, n;
+	double t, u, g0, g1;
+	double *cut;
+	point3 *p, *q;
+
+	cut = sc->t;
+
+	n = 0;
+	cut[n++] = 0;
+	cut[n++] = 1;
+
+	p = &(s->screen[face->face[face->num_v - 1]]);
+	for (i = 0; i < face->num_v; ++i) {
+		q = &(s->screen[face->face[i]]);
+
+		/* edges parallel to the face edge never cross it */
+		if (crossing(a, b, p, q, &t, &u) &&
+		    t > 0 && t < 1 && u >= 0 && u <= 1) {
+			cut[n++] = t;
+		}
+
+		p = q;
+	}
+
+	/* how far the face is in front of the edge at either end */
+	g0 = face_depth(hf, a->x, a->y) - a->z;
+	g1 = face_depth(hf, b->x, b->y) - b->z;
+
+	if ((g0 < 0 && g1 > 0) || (g0 > 0 && g1 < 0)) {
+		cut[n++] = g0 / (g0 - g1);
+	}
+
+	sort_cuts(cut, n);
+
+	for (i = 0; i + 1 < n; ++i) {
+		if (cut[i + 1] <= cut[i]) {
+			continue;
+		}
+
+		t = (cut[i] + cut[i + 1]) / 2;
+
+		if (g0 + t * (g1 - g0) > HL_EPSILON &&
+		    inside_face(s, face, a->x + t * (b->x - a->x),
+				a->y + t * (b->y - a->y)) &&
+		    add_hidden(sc, cut[i], cut[i + 1]) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * marks a new edge being tested, so every face and silhouette is only tested
+ * once against it even if it's in several of the tiles under the edge
+ */
+static
+void
+next_stamp(struct hl_scratch *sc)
+{
+	if (++sc->stamp == INT_MAX) {
+		memset(sc->seen, 0, sizeof(int) * sc->max_seen);
+		memset(sc->sil_seen, 0, sizeof(int) * sc->max_sil_seen);
+		sc->stamp = 1;
+	}
+}
+
+/*
+ * finds exactly which parts of an edge are hidden, in the spirit of Appel's
+ * algorithm: the projected edge is intersected with the projection of every
+ * face it overlaps, and the pieces where a face is in front of it are hidden.
+ * This works for any shape with faces, convex or not
+ *
+ * the cost depends on how many faces the edge overlaps on the screen rather
+ * than on how many points the edge is drawn with, since only the faces binned
+ * in the tiles under the edge are looked at, and those whose bounding box
+ * misses the edge or that are entirely behind it are skipped
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+hide_by_faces(struct shape *s, struct hl_scratch *sc, struct edge *edge,
+	      int x0, int x1, int y0, int y1)
+{
+	int i, f, x, y, *tile;
+	double min_x, max_x, min_y, max_y, min_z;
+	point3 *a, *b;
+	struct hl_box *box;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+
+	min_x = fmin(a->x, b->x);
+	max_x = fmax(a->x, b->x);
+	min_y = fmin(a->y, b->y);
+	max_y = fmax(a->y, b->y);
+	min_z = fmin(a->z, b->z);
+
+	for (y = y0; y <= y1; ++y) {
+		for (x = x0; x <= x1; ++x) {
+			tile = &(hl->face_bins.start[y * hl->tiles_x + x]);
+
+			for (i = tile[0]; i < tile[1]; ++i) {
+				f = hl->face_bins.items[i];
+				box = &(hl->face_box[f]);
+
+				/* the edge lies on its own faces */
+				if (sc->seen[f] == sc->stamp ||
+				    edge_on_face(s, edge, f)) {
+					continue;
+				}
+
+				sc->seen[f] = sc->stamp;
+
+				if (box->max_x < min_x || box->min_x > max_x ||
+				    box->max_y < min_y || box->min_y > max_y ||
+				    hl->faces[f].max_z <= min_z + HL_EPSILON) {
+					continue;
+				}
+
+				if (hide_by_face(s, sc, &(hl->faces[f]),
+						 &(s->faces[f]), a, b) != 0) {
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * finds which parts of an edge are hidden using only the silhouettes. On a
+ * surface that doesn't cross itself, what's in front of a point on an edge
+ * can only change where the edge goes behind a silhouette, so the edge is cut
+ * where it crosses a silhouette that's in front of it, and each piece between
+ * cuts is hidden or not as a whole, which is tested at its middle
+ *
+ * there are far fewer silhouettes than faces, and a piece is only tested
+ * against the faces in its tile once, instead of every face being
+ * intersected with the edge
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+hide_by_silhouettes(struct shape *s, struct hl_scratch *sc,
+		    struct edge *edge, int x0, int x1, int y0, int y1)
+{
+	int i, k, n, x, y, *tile;
+	double t, u, min_x, max_x, min_y, max_y;
+	double *cut;
+	point3 *a, *b, *p, *q, mid;
+	struct hl_box *box;
+	struct half_edge *he;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	cut = sc->t;
+
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+
+	min_x = fmin(a->x, b->x);
+	max_x = fmax(a->x, b->x);
+	min_y = fmin(a->y, b->y);
+	max_y = fmax(a->y, b->y);
+
+	n = 0;
+	cut[n++] = 0;
+	cut[n++] = 1;
+
+	for (y = y0; y <= y1; ++y) {
+		for (x = x0; x <= x1; ++x) {
+			tile = &(hl->sil_bins.start[y * hl->tiles_x + x]);
+
+			for (i = tile[0]; i < tile[1]; ++i) {
+				k = hl->sil_bins.items[i];
+				box = &(hl->sil_box[k]);
+
+				if (sc->sil_seen[k] == sc->stamp) {
+					continue;
+				}
+
+				sc->sil_seen[k] = sc->stamp;
+
+				if (box->max_x < min_x || box->min_x > max_x ||
+				    box->max_y < min_y || box->min_y > max_y) {
+					continue;
+				}
+
+				he = &(s->half_edges[hl->sil[k]]);
+				p = &(s->screen[he->origin]);
+				q = &(s->screen[s->half_edges[he->next].origin]);
+
+				/* only silhouettes in front of the edge count */
+				if (crossing(a, b, p, q, &t, &u) &&
+				    t > 0 && t < 1 && u >= 0 && u <= 1 &&
+				    p->z + u * (q->z - p->z) >
+				    a->z + t * (b->z - a->z) + HL_EPSILON) {
+					cut[n++] = t;
+				}
+			}
+		}
+	}
+
+	sort_cuts(cut, n);
+
+	for (i = 0; i + 1 < n; ++i) {
+		if (cut[i + 1] <= cut[i]) {
+			continue;
+		}
+
+		t = (cut[i] + cut[i + 1]) / 2;
+		mid.x = a->x + t * (b->x - a->x);
+		mid.y = a->y + t * (b->y - a->y);
+		mid.z = a->z + t * (b->z - a->z);
+
+		/* the edge lies on its own faces */
+		if (covered(s, &mid, edge) &&
+		    add_hidden(sc, cut[i], cut[i + 1]) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * finds the hidden intervals of an edge, from the silhouettes if the shape is
+ * simple and from every face it overlaps if not, and leaves them in
+ * sc->hidden sorted and merged
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+find_hidden(struct shape *s, struct hl_scratch *sc, struct edge *edge)
+{
+	int x0, x1, y0, y1, err;
+	point3 *a, *b;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	sc->num_hidden = 0;
+
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+
+	/* off the screen nothing is drawn, so nothing has to be hidden */
+	if (!tile_range(fmin(a->x, b->x), fmax(a->x, b->x), hl->tile_w,
+			hl->tiles_x, &x0, &x1) ||
+	    !tile_range(fmin(a->y, b->y), fmax(a->y, b->y), hl->tile_h,
+			hl->tiles_y, &y0, &y1)) {
+		return 0;
+	}
+
+	next_stamp(sc);
+
+	if (hl->simple) {
+		err = hide_by_silhouettes(s, sc, edge, x0, x1, y0, y1);
+	} else {
+		err = hide_by_faces(s, sc, edge, x0, x1, y0, y1);
+	}
+
+	if (err != 0) {
+		return -1;
+	}
+
+	merge_hidden(sc);
+
+	return 0;
+}
+
+/*
+ * hidden intervals of an edge, left in the scratch sc sorted and merged.
+ * They're taken from the cache if the edge is in it, else found by
+ * find_hidden(). Only the cache is shared, and it's only read, so threads can
+ * call this for different edges at once, each with its own scratch
+ *
+ * returns 0 on success, -1 if an allocation failed (in which case nothing is
+ * hidden)
+ */
+int
+hl_edge(struct shape *s, struct edge *edge, struct hl_scratch *sc)
+{
+	int e;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	e = edge - s->edges;
+
+	if (hl->cache_count[e] >= 0) {
+		sc->num_hidden = 0;
+		if (reserve_hidden(sc, hl->cache_count[e]) != 0) {
+			return -1;
+		}
+
+		sc->num_hidden = hl->cache_count[e];
+		if (sc->num_hidden > 0) {
+			memcpy(sc->hidden, &(hl->cache[hl->cache_first[e]]),
+			       sizeof(struct interval) * sc->num_hidden);
+		}
+
+		return 0;
+	}
+
+	if (find_hidden(s, sc, edge) != 0) {
+		sc->num_hidden = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * copies the n hidden intervals of an edge, found by hl_edge(), into the cache
+ * unless the edge is already in it. If there isn't room the edge just isn't
+ * cached. This must not run while another thread is in hl_edge()
+ *
+ * only edges entirely on the screen are cached, since faces off the screen
+ * aren't binned, and moving the shape can bring them on to it
+ */
+void
+hl_cache_edge(struct shape *s, struct edge *edge, struct interval *hidden,
+	      int n)
+{
+	int e, max;
+	point3 *a, *b;
+	struct interval *cache;
+	struct hidden_line *hl;
+
+	hl = s->hl;
+	e = edge - s->edges;
+
+	if (hl->cache_count[e] >= 0) {
+		return;
+	}
+
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+	if (fmin(a->x, b->x) < 0 || fmin(a->y, b->y) < 0 ||
+	    fmax(a->x, b->x) >= s->view.cols * s->view.dots_x ||
+	    fmax(a->y, b->y) >= s->view.rows * s->view.dots_y) {
+		return;
+	}
+
+	if (hl->num_cache + n > hl->max_cache) {
+		max = hl->max_cache ? 2 * hl->max_cache : 64;
+		max = max < hl->num_cache + n ? hl->num_cache + n : max;
+
+		cache = realloc(hl->cache, sizeof(struct interval) * max);
+		if (cache == NULL) {
+			return;
+		}
+
+		hl->cache = cache;
+		hl->max_cache = max;
+	}
+
+	if (n > 0) {
+		memcpy(&(hl->cache[hl->num_cache]), hidden,
+		       sizeof(struct interval) * n);
+	}
+
+	hl->cache_first[e] = hl->num_cache;
+	hl->cache_count[e] = n;
+	hl->num_cache += n;
+}
+
+/*
+ * occlusion method that works for any shape with faces, by testing whether
+ * each point is inside of the projection of a face that's in front of it
+ *
+ * returns a mask with bit i set if point i should be occluded
+ */
+uint64_t
+occlude_block_analytic(struct shape *s, struct point_block *b)
+{
+	int i;
+	uint64_t mask;
+	point3 p;
+	struct viewport *v;
+
+	v = &(s->view);
+
+	mask = 0;
+	for (i = 0; i < b->n; ++i) {
+		p.x = b->x[i] * v->scale_x + v->off_x;
+		p.y = b->y[i] * v->scale_y + v->off_y;
+		p.z = b->z[i];
+
+		mask |= (uint64_t) covered(s, &p, NULL) << i;
+	}
+
+	return mask;
+}
+
+/*
+ * free memory allocated for ANALYTIC occlusion
+ */
+void
+hl_destroy(struct hidden_line *hl)
+{
+	int i;
+
+	if (hl == NULL) {
+		return;
+	}
+
+	for (i = 0; i < hl->num_scratch; ++i) {
+		free(hl->scratch[i].hidden);
+		free(hl->scratch[i].t);
+		free(hl->scratch[i].seen);
+		free(hl->scratch[i].sil_seen);
+	}
+
+	free(hl->scratch);
+	free(hl->faces);
+	free(hl->face_box);
+	free(hl->face_bins.start);
+	free(hl->face_bins.items);
+	free(hl->sil);
+	free(hl->sil_box);
+	free(hl->sil_bins.start);
+	free(hl->sil_bins.items);
+	free(hl->cache_first);
+	free(hl->cache_count);
+	free(hl->cache);
+	free(hl->spare);
+	free(hl->last_screen);
+	free(hl->swept);
+	free(hl->swept_bins.start);
+	free(hl->swept_bins.items);
+	free(hl);
+}
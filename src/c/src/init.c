@@ -4,6 +4,14 @@
 #include <string.h>
 
 #include "init.h"
+#include "framebuffer.h"
+#include "zbuffer.h"
+#include "bvh.h"
+#include "hidden_line.h"
+#include "raster_pool.h"
+#include "half_edge.h"
+#include "convex_occlusion.h"
+#include "transform.h"
 #include "vector.h"
 #include "term_shapes.h"
 
@@ -75,9 +83,27 @@ init_from_file(char *fname, struct shape *s)
 		goto cleanup_file;
 	}
 
+	/*
+	 * the vertices as read, which the model places in the world, stored
+	 * as a run of each coordinate
+	 */
+	s->object.x = malloc(sizeof(double) * 3 * s->num_v + 1);
+	if (s->object.x == NULL) {
+		goto cleanup_vertices;
+	}
+
+	s->object.y = s->object.x + s->num_v;
+	s->object.z = s->object.y + s->num_v;
+
+	/* the vertices projected on to the screen, filled in every frame */
+	s->screen = malloc(sizeof(point3) * s->num_v);
+	if (s->screen == NULL) {
+		goto cleanup_object;
+	}
+
 	s->edges = malloc(sizeof(struct edge) * s->num_e);
 	if (s->edges == NULL) {
-		goto cleanup_vertices;
+		goto cleanup_screen;
 	}
 
 	s->faces = malloc(sizeof(struct face) * s->num_f);
@@ -85,31 +111,61 @@ init_from_file(char *fname, struct shape *s)
 		goto cleanup_edges;
 	}
 
-	/* allocate space to hold coordinates for printing step */
-	s->fronts = malloc(sizeof(struct point_to_print) * (s->num_e + 1) * (s->e_density + 1));
-	if (s->fronts == NULL) {
+	/* normals of the faces in object space, the same way as the vertices */
+	s->object_normals.x = malloc(sizeof(double) * 3 * s->num_f + 1);
+	if (s->object_normals.x == NULL) {
 		goto cleanup_faces;
 	}
 
-	s->behinds = malloc(sizeof(struct point_to_print) * (s->num_e + 1) * (s->e_density + 1));
-	if (s->behinds == NULL) {
-		goto cleanup_fronts;
+	s->object_normals.y = s->object_normals.x + s->num_f;
+	s->object_normals.z = s->object_normals.y + s->num_f;
+
+	s->normals = malloc(sizeof(point3) * s->num_f + 1);
+	if (s->normals == NULL) {
+		goto cleanup_object_normals;
+	}
+
+	/*
+	 * framebuffer to hold the points for the printing step, sized to the
+	 * screen when printing
+	 */
+	s->fb = fb_create();
+	if (s->fb == NULL) {
+		goto cleanup_normals;
+	}
+
+	/* depth buffer for EXACT occlusion, sized along with the framebuffer */
+	s->zb = zb_create();
+	if (s->zb == NULL) {
+		goto cleanup_fb;
 	}
 
+	/* projected faces for ANALYTIC occlusion */
+	s->hl = hl_create();
+	if (s->hl == NULL) {
+		goto cleanup_zb;
+	}
+
+	/* threads for drawing edges, started when they're first used */
+	s->pool = NULL;
+
 	/* read 3D coordinates describing every vertex */
 	for (i = 0; i < num_v; ++i) {
 		err = fscanf(file, "%lf, %lf, %lf", &x, &y, &z);
 		if (err == EOF) {
 			fprintf(stderr, "Returned EOF when reading vertices in shape file\n");
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		} else if (err == 0) {
 			fprintf(stderr, "Zero bytes read when reading vertices in shape file\n");
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		}
 
-		s->vertices[i].x = x;
-		s->vertices[i].y = y;
-		s->vertices[i].z = z;
+		s->object.x[i] = x;
+		s->object.y[i] = y;
+		s->object.z[i] = z;
+
+		/* the model starts out placing the object as it is */
+		s->vertices[i] = (point3) {x, y, z};
 	}
 
 	/* read indices of edges described by two vertices */
@@ -117,15 +173,15 @@ init_from_file(char *fname, struct shape *s)
 		err = fscanf(file, "%i, %i", &e0, &e1);
 		if (err == EOF) {
 			fprintf(stderr, "Returned EOF when reading edges in shape file\n");
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		} else if (err == 0) {
 			fprintf(stderr, "Zero bytes read when reading edges in shape file\n");
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		}
 
 		if (e0 < 0 || e0 > num_v - 1 || e1 < 0 || e1 > num_v -1) {
 			fprintf(stderr, "Edge index out of bounds\n");
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		}
 
 		s->edges[i].edge[0] = e0;
@@ -135,7 +191,7 @@ init_from_file(char *fname, struct shape *s)
 	for (i = 0; i < num_f; ++i) {
 		str = fgets(buf, FACE_VERTS_BUFSIZE, file);
 		if (str == NULL) {
-			goto cleanup_behinds;
+			goto cleanup_hl;
 		} else if (*buf == '\n') { /* skip the single newline */
 			i--;
 			continue;
@@ -181,18 +237,56 @@ init_from_file(char *fname, struct shape *s)
 		s->faces[i].num_v = k;
 	}
 
+	/* link the edges and faces to each other */
+	if (build_half_edges(s) != 0) {
+		goto cleanup_face_vertices;
+	}
+
+	/* edge functions of the faces, filled in by project_faces() */
+	s->edge_fn = malloc(sizeof(double) * 3 * s->num_he + 1);
+	if (s->edge_fn == NULL) {
+		goto cleanup_half_edges;
+	}
+
+	/* flattened vertices of the faces, also filled in by project_faces() */
+	s->face_uv = malloc(sizeof(double) * 2 * s->num_he + 1);
+	if (s->face_uv == NULL) {
+		goto cleanup_edge_fn;
+	}
+
+	/* boxes around the faces for tracing occlusion rays */
+	if (build_bvh(s) != 0) {
+		goto cleanup_face_uv;
+	}
+
 	fclose(file);
 
-	/* calculate the normal for each face */
+	/*
+	 * calculate the normal for each face, which is only turned by the
+	 * model after this
+	 */
 	for (i = 0; i < num_f; ++i) {
 		vector3_normal(&(s->vertices[s->faces[i].face[0]]),
 			       &(s->vertices[s->faces[i].face[1]]),
 			       &(s->vertices[s->faces[i].face[2]]),
-			       &(s->faces[i].normal));
+			       &(s->normals[i]));
+
+		s->object_normals.x[i] = s->normals[i].x;
+		s->object_normals.y[i] = s->normals[i].y;
+		s->object_normals.z[i] = s->normals[i].z;
 	}
 
+	/* which side of each face is the outside, for convex solids */
+	orient_faces(s);
+	s->convex = check_convex(s);
 
 	s->center = (point3) {0.0, 0.0, 0.0};
+	s->model = (struct model) {
+		{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+		1
+	};
+	s->moved = 0;
+	motion_reset(&(s->motion));
 	s->fname = fname;
 
 	/*
@@ -205,22 +299,46 @@ init_from_file(char *fname, struct shape *s)
 	s->print_edges = 1;
 
 	s->occlusion = NONE;
+	s->raster = SAMPLE;
+	s->pixels = HALF_BLOCK;
+	s->fill = 0;
+	s->autorotate = 0;
+	s->interval.tv_sec = 0;
+	s->interval.tv_nsec = 60000000;
 	s->cop = (point3) COP;
+	s->turns = 0;
+	s->sides_valid = 0;
 
 	return 0;
 
+cleanup_face_uv:
+	free(s->face_uv);
+cleanup_edge_fn:
+	free(s->edge_fn);
+cleanup_half_edges:
+	free(s->half_edges);
 cleanup_face_vertices:
 	for (i = 0; i < num_f; ++i) {
 		free(s->faces[i].face);
 	}
-cleanup_behinds:
-	free(s->behinds);
-cleanup_fronts:
-	free(s->fronts);
+cleanup_hl:
+	hl_destroy(s->hl);
+cleanup_zb:
+	zb_destroy(s->zb);
+cleanup_fb:
+	fb_destroy(s->fb);
+cleanup_normals:
+	free(s->normals);
+cleanup_object_normals:
+	free(s->object_normals.x);
 cleanup_faces:
 	free(s->faces);
 cleanup_edges:
 	free(s->edges);
+cleanup_screen:
+	free(s->screen);
+cleanup_object:
+	free(s->object.x);
 cleanup_vertices:
 	free(s->vertices);
 cleanup_file:
@@ -249,15 +367,27 @@ destroy_shape(struct shape *s)
 	int i;
 
 	free(s->vertices);
+	free(s->object.x);
+	free(s->screen);
 	free(s->edges);
-	free(s->behinds);
-	free(s->fronts);
+	fb_destroy(s->fb);
+	zb_destroy(s->zb);
+	hl_destroy(s->hl);
+	raster_pool_destroy(s->pool);
+	free(s->half_edges);
+	free(s->edge_fn);
+	free(s->face_uv);
+	free(s->bvh);
+	free(s->bvh_faces);
+	free(s->bvh_planes);
 
 	for (i = 0; i < s->num_f; ++i) {
 		free(s->faces[i].face);
 	}
 
 	free(s->faces);
+	free(s->object_normals.x);
+	free(s->normals);
 }
 
 /*
@@ -10,37 +10,45 @@
  * operates by finding the angle between the vectors given by the point to the
  * center of the object and the point to the center of projection. This is only
  * an approximation as the angle given by this calculation doesn't determine
- * entirely whether a point should be occluded. The threshold is given by pi/3,
- * but as this is approximate it can be adjusted.
+ * entirely whether a point should be occluded. A point is occluded when the
+ * angle is under pi/3, which is when its cosine is over APPROX_COS, so the
+ * cosine is compared directly instead of taking its arc cosine
  *
- * returns 0 if point should be rendered, else 1
+ * the points of the block are independent and branch free, so the compiler
+ * can work on several at once
+ *
+ * returns a mask with bit i set if point i should be occluded
  */
-int
-occlude_point_approx(struct shape *s, point3 *point)
+uint64_t
+occlude_block_approx(struct shape *s, struct point_block *b)
 {
-	double dprod, mag0, mag1, theta;
-	point3 v0, v1;
-
-	/* vector from point to the center of solid */
-	vector3_sub(&(s->center), point, &v0);
-
-	/* vector from point to the center of projection */
-	vector3_sub(&(s->cop), point, &v1);
-
-	/*
-	 * angle between two vectors is given by the arc cosine of the dot
-	 * product of the two vectors divided by the product of magnitudes of
-	 * the vectors
-	 */
-	dprod = vector3_dot(&v0, &v1);
-	mag0 = vector3_mag(&v0);
-	mag1 = vector3_mag(&v1);
-
-	theta = acos(dprod / (mag0 * mag1));
-
-	if (theta < M_PI / 3) {
-		return 1;
+	int i;
+	double v0x, v0y, v0z, v1x, v1y, v1z, dprod, mag2;
+	uint64_t mask;
+
+	mask = 0;
+	for (i = 0; i < b->n; ++i) {
+		/* vector from point to the center of solid */
+		v0x = s->center.x - b->x[i];
+		v0y = s->center.y - b->y[i];
+		v0z = s->center.z - b->z[i];
+
+		/* vector from point to the center of projection */
+		v1x = s->cop.x - b->x[i];
+		v1y = s->cop.y - b->y[i];
+		v1z = s->cop.z - b->z[i];
+
+		/*
+		 * cosine of the angle between two vectors is given by the dot
+		 * product of the two vectors divided by the product of
+		 * magnitudes of the vectors
+		 */
+		dprod = v0x * v1x + v0y * v1y + v0z * v1z;
+		mag2 = (v0x * v0x + v0y * v0y + v0z * v0z) *
+		       (v1x * v1x + v1y * v1y + v1z * v1z);
+
+		mask |= (uint64_t) (dprod > APPROX_COS * sqrt(mag2)) << i;
 	}
 
-	return 0;
+	return mask;
 }
@@ -0,0 +1,233 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "present.h"
+#include "backend.h"
+#include "framebuffer.h"
+#include "term_shapes.h"
+
+/*
+ * what a cell looks like on the screen: the text printed over it if there is
+ * any, else the front dots if anything in front was drawn there, else the
+ * behind dots if those are shown, else the shade of the face under it (0 for
+ * blank)
+ */
+static
+uint32_t
+resolve(struct framebuffer *fb, int row, int col, int show_behind)
+{
+	uint16_t cell;
+	uint8_t text;
+
+	text = fb->text[row * fb->cols + col];
+	if (text) {
+		return (uint32_t) text << 24;
+	}
+
+	cell = *fb_cell(fb, row, col);
+
+	if (cell & FB_FRONT) {
+		return cell & FB_FRONT;
+	} else if (show_behind && (cell & FB_BEHIND)) {
+		return cell & FB_BEHIND;
+	}
+
+	return (uint32_t) fb->shade[row * fb->cols + col] << 16;
+}
+
+/*
+ * attribute a resolved cell is drawn with. The character is written to out
+ * and its length in bytes to len
+ */
+static
+enum backend_attr
+cell_look(uint32_t v, enum pixel_mode mode, char *out, int *len)
+{
+	if (v >> 24) {
+		*out = v >> 24;
+		*len = 1;
+		return ATTR_NORMAL;
+	} else if (v & FB_FRONT) {
+		*len = fb_glyph(v & FB_FRONT, mode, out);
+		return ATTR_BOLD;
+	} else if (v & FB_BEHIND) {
+		*len = fb_glyph((v & FB_BEHIND) >> 8, mode, out);
+		return ATTR_DIM;
+	} else if (v) {
+		*out = v >> 16;
+		*len = 1;
+		return ATTR_NORMAL;
+	}
+
+	*out = ' ';
+	*len = 1;
+	return ATTR_NORMAL;
+}
+
+/*
+ * writes the cells from col to end (inclusive) of a row to the backend and
+ * records them as presented. Cells are handed to the backend in runs that
+ * share an attribute
+ */
+static
+void
+present_span(struct shape *s, int row, int col, int end, int show_behind)
+{
+	int start, pos, start_pos, len;
+	uint32_t v;
+	enum backend_attr attr, run_attr;
+	struct framebuffer *fb;
+
+	fb = s->fb;
+	fb->stats.spans++;
+
+	start = col;
+	pos = 0;
+	start_pos = 0;
+	run_attr = ATTR_NORMAL;
+
+	for (; col <= end; ++col) {
+		v = resolve(fb, row, col, show_behind);
+
+		if (fb->prev[row * fb->cols + col] != v) {
+			fb->stats.cells++;
+		}
+
+		fb->prev[row * fb->cols + col] = v;
+
+		/* characters may take more than a byte, so line is indexed by pos */
+		attr = cell_look(v, s->pixels, &(fb->line[pos]), &len);
+		if (col == start) {
+			run_attr = attr;
+		} else if (attr != run_attr) {
+			fb->stats.bytes += s->backend->put(s->backend, row, start,
+					&(fb->line[start_pos]), pos - start_pos,
+					run_attr);
+
+			start = col;
+			start_pos = pos;
+			run_attr = attr;
+		}
+
+		pos += len;
+	}
+
+	fb->stats.bytes += s->backend->put(s->backend, row, start,
+			&(fb->line[start_pos]), pos - start_pos, run_attr);
+}
+
+/*
+ * writes the framebuffer to the screen, touching only the cells that differ
+ * from the previous frame instead of clearing and redrawing the whole screen
+ *
+ * changed cells on a row are grouped into spans, where a span continues over
+ * fewer than PRESENT_GAP unchanged cells since rewriting those is cheaper than
+ * moving the cursor past them
+ */
+void
+present_frame(struct shape *s)
+{
+	int row, col, start, end, gap, show_behind;
+	struct framebuffer *fb;
+
+	fb = s->fb;
+	show_behind = s->occlusion != CONVEX && s->occlusion != EXACT &&
+		      s->occlusion != ANALYTIC;
+
+	fb->stats.cells = 0;
+	fb->stats.spans = 0;
+	fb->stats.bytes = 0;
+
+	for (row = 0; row < fb->rows; ++row) {
+		col = 0;
+
+		while (col < fb->cols) {
+			/* find the start of the next changed run */
+			if (resolve(fb, row, col, show_behind) ==
+			    fb->prev[row * fb->cols + col]) {
+				col++;
+				continue;
+			}
+
+			start = col;
+			end = col;
+			gap = 0;
+
+			for (col = start + 1; col < fb->cols; ++col) {
+				if (resolve(fb, row, col, show_behind) !=
+				    fb->prev[row * fb->cols + col]) {
+					end = col;
+					gap = 0;
+				} else if (++gap >= PRESENT_GAP) {
+					break;
+				}
+			}
+
+			present_span(s, row, start, end, show_behind);
+			col = end + 1;
+		}
+	}
+}
+
+/*
+ * puts text over the frame being drawn, to be presented with it. Like the
+ * cells, it's only written to the screen where it differs from what the last
+ * present left there. Only printable ASCII is kept, one character per cell
+ */
+void
+present_text(struct shape *s, int row, int col, const char *fmt, ...)
+{
+	int len, i;
+	char buf[256];
+	va_list ap;
+	struct framebuffer *fb;
+
+	fb = s->fb;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || row < 0 || row >= fb->rows) {
+		return;
+	} else if (len >= (int) sizeof(buf)) {
+		len = sizeof(buf) - 1;
+	}
+
+	for (i = 0; i < len && col + i < fb->cols; ++i) {
+		if (col + i < 0) {
+			continue;
+		}
+
+		fb->text[row * fb->cols + col + i] =
+			buf[i] >= ' ' && buf[i] <= '~' ? buf[i] : '?';
+	}
+}
+
+/*
+ * prints text over the presented frame right away, for prompts that wait for
+ * input before the next frame. The cells written over are marked as unknown,
+ * so the next present restores them
+ */
+void
+present_printf(struct shape *s, int row, int col, const char *fmt, ...)
+{
+	int len;
+	char buf[256];
+	va_list ap;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (len < 0) {
+		return;
+	} else if (len >= (int) sizeof(buf)) {
+		len = sizeof(buf) - 1;
+	}
+
+	fb_invalidate_span(s->fb, row, col, len);
+	s->fb->stats.bytes += s->backend->put(s->backend, row, col,
+			buf, len, ATTR_NORMAL);
+}
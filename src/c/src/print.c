@@ -1,263 +1,858 @@
-#include <ncurses.h>
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "print.h"
+#include "framebuffer.h"
+#include "present.h"
+#include "backend.h"
 #include "convex_occlusion.h"
+#include "bvh.h"
+#include "zbuffer.h"
+#include "hidden_line.h"
+#include "raster_pool.h"
+#include "shade.h"
+#include "transform.h"
 #include "vector.h"
 #include "term_shapes.h"
 
 /*
- * translate an x and y value based on the window dimensions and some magic
- * numbers so an object described with a "radius" approximately 1 will be
- * centered in the center of the screen and entirely fit on the screen
+ * sets up the projection for a frame from the size of the framebuffer, using
+ * some magic numbers so an object described with a "radius" approximately 1
+ * will be centered in the center of the screen and entirely fit on the screen
  */
 static
-enum t_pixel_print
-movexy(double *x, double *y)
+void
+viewport_update(struct shape *s)
 {
-	int winx, winy;
-	double integralx, integraly, fractionalx, fractionaly;
+	struct viewport *v;
 
-	getmaxyx(stdscr, winy, winx);
+	v = &(s->view);
 
-	fractionalx = ((*x * SCALE * winy) + (0.5 * winx));
-	fractionaly = (-(*y * SCALE * .5 * winy) + (0.5 * winy));
+	v->rows = s->fb->rows;
+	v->cols = s->fb->cols;
+	v->dots_x = fb_dots_x(s->pixels);
+	v->dots_y = fb_dots_y(s->pixels);
 
-	fractionalx = modf(fractionalx, &integralx);
-	fractionaly = modf(fractionaly, &integraly);
+	v->scale_x = SCALE * v->rows * v->dots_x;
+	v->off_x = 0.5 * v->cols * v->dots_x;
 
-	*x = integralx;
-	*y = integraly;
+	/* y is reversed since rows count down the screen */
+	v->scale_y = -SCALE * .5 * v->rows * v->dots_y;
+	v->off_y = 0.5 * v->rows * v->dots_y;
+}
 
-	/* opposite direction than what's intuitive because y is reversed */
-	if (fractionaly >= 0.5) {
-		return LOWER;
+/*
+ * floor of a / b for b > 0, rounding towards negative infinity rather than
+ * towards zero like the / operator
+ */
+static
+long
+floor_div(long a, long b)
+{
+	if (a >= 0) {
+		return a / b;
 	}
 
-	return UPPER;
+	return -((-a + b - 1) / b);
+}
+
+/*
+ * midpoint between two points
+ * TODO: move somewhere else
+ */
+static
+void
+midpoint(point3 *p0, point3 *p1, point3 *mp)
+{
+	mp->x = (p0->x + p1->x) / 2;
+	mp->y = (p0->y + p1->y) / 2;
+	mp->z = (p0->z + p1->z) / 2;
 }
 
 /*
- * searches a point_to_print array to determine if the point on the ncurses
- * screen has already been processed including the t_pixel_print.
+ * points of a partially occluded edge waiting to be tested for occlusion
+ * together, with the dots they go in
  *
- * if there's no match on the {x y} coordinates, return -2.
+ * points that go in the same dot as the point before them would be skipped
+ * if it's drawn, so they aren't tested with the rest. They're kept in more
+ * (as long as the occlusion method leaves occluded dots empty), along with
+ * which point they follow, and are only tested if that one is occluded
+ */
+struct pending {
+	struct point_block points;
+	long dotx[OCC_BLOCK];
+	long doty[OCC_BLOCK];
+	uint32_t key[OCC_BLOCK];
+
+	struct point_block more;
+	int follows[OCC_BLOCK];
+};
+
+/*
+ * how much of an edge is hidden. For a PARTIAL edge with ANALYTIC occlusion,
+ * hidden is where, as n sorted intervals
+ */
+struct edge_hidden {
+	enum edge_occlusion state;
+	struct interval *hidden;
+	int n;
+};
+
+/*
+ * cells laid out like the framebuffer that edges are drawn into. Drawn in
+ * order, a dot is filled by the first point to reach it. When the edges are
+ * drawn out of order, keys holds the key of the point that filled each dot
+ * (see struct raster_pool), and a point with a lower key takes the dot over
+ */
+struct raster_target {
+	uint16_t *cells;
+	uint32_t *keys;   /* NULL if drawn in order */
+	uint8_t *touched; /* rows drawn into, only with keys */
+};
+
+/*
+ * whether the occlusion method leaves occluded dots empty instead of drawing
+ * them as "behind"
+ */
+static inline
+int
+hides_points(struct shape *s)
+{
+	return s->occlusion == CONVEX || s->occlusion == EXACT ||
+	       s->occlusion == ANALYTIC;
+}
+
+/*
+ * cell of the target the given dot is in, which of its dots it is, and where
+ * its key is, unless the dot is off the screen or has already been filled by
+ * a point before the one with the given key
  *
- * if there's a match on the {x y} coordinates and the t_pixel_print is the
- * same, return -1.
+ * returns NULL if nothing should be put in the dot
+ */
+static
+uint16_t *
+free_dot(struct shape *s, struct raster_target *tgt, long dotx, long doty,
+	 uint32_t key, uint16_t *dot, size_t *slot)
+{
+	int sx, sy;
+	size_t k;
+	uint16_t *cell;
+
+	sx = s->view.dots_x;
+	sy = s->view.dots_y;
+
+	if (dotx < 0 || dotx >= (long) s->fb->cols * sx ||
+	    doty < 0 || doty >= (long) s->fb->rows * sy) {
+		return NULL;
+	}
+
+	*dot = fb_dot(s->pixels, dotx % sx, doty % sy);
+
+	k = (size_t) (doty / sy) * s->fb->cols + dotx / sx;
+	cell = &(tgt->cells[k]);
+
+	if (tgt->keys != NULL) {
+		*slot = k * sx * sy + (doty % sy) * sx + dotx % sx;
+		if (tgt->keys[*slot] < key) {
+			return NULL;
+		}
+
+		tgt->touched[doty / sy] = 1;
+		return cell;
+	}
+
+	if (*cell & (*dot | *dot << 8)) {
+		return NULL;
+	}
+
+	return cell;
+}
+
+/*
+ * marks the dot of the cell as either "behind" or "in front", unless it's
+ * occluded and the occlusion method doesn't show what's behind. With keys,
+ * whatever a later point put in the dot is replaced
+ */
+static
+void
+mark_dot(struct shape *s, struct raster_target *tgt, uint16_t *cell,
+	 uint16_t dot, size_t slot, uint32_t key, int occlude_val)
+{
+	if (hides_points(s) && occlude_val) {
+		return;
+	}
+
+	if (tgt->keys != NULL) {
+		*cell &= ~(dot | dot << 8);
+		tgt->keys[slot] = key;
+	}
+
+	*cell |= (occlude_val == 1) ? dot << 8 : dot;
+}
+
+/*
+ * tests the pending points of an edge for occlusion as one block and puts
+ * them into the target in the order they were added. A dot can be filled
+ * by an earlier point of the same block, so it's checked again
  *
- * if there's a match but the t_pixel_print is different, return the index of
- * the match.
+ * an occluded point's dot is left empty, so it's drawn if any of the points
+ * that follow it in the same dot isn't occluded. Those are tested as a second
+ * block, packed in place
  */
 static
-ssize_t
-search_ptp(struct point_to_print *arr, ssize_t len, struct point_to_print *p)
+void
+flush_points(struct shape *s, struct raster_target *tgt, struct edge *edge,
+	     struct pending *pend)
 {
-	ssize_t i;
+	int i, n;
+	size_t slot;
+	uint64_t mask, more;
+	uint16_t *cell, dot;
+	struct point_block *b;
+
+	if (pend->points.n == 0) {
+		return;
+	}
 
-	for (i = 0; i < len; ++i) {
-		if (p->x == arr[i].x && p->y == arr[i].y) {
-			if (p->t == arr[i].t || arr[i].t == FULL) {
-				return -1;
-			}
+	mask = occlude_block(s, &(pend->points), edge);
+
+	b = &(pend->more);
+	n = 0;
+	for (i = 0; i < b->n; ++i) {
+		if ((mask >> pend->follows[i]) & 1) {
+			b->x[n] = b->x[i];
+			b->y[n] = b->y[i];
+			b->z[n] = b->z[i];
+			pend->follows[n++] = pend->follows[i];
+		}
+	}
+
+	b->n = n;
+	more = n > 0 ? occlude_block(s, b, edge) : 0;
+
+	for (i = 0; i < n; ++i) {
+		if (!((more >> i) & 1)) {
+			mask &= ~((uint64_t) 1 << pend->follows[i]);
+		}
+	}
 
-			return i;
+	for (i = 0; i < pend->points.n; ++i) {
+		cell = free_dot(s, tgt, pend->dotx[i], pend->doty[i],
+				pend->key[i], &dot, &slot);
+		if (cell != NULL) {
+			mark_dot(s, tgt, cell, dot, slot, pend->key[i],
+				 (mask >> i) & 1);
 		}
 	}
 
-	return -2;
+	pend->points.n = 0;
+	pend->more.n = 0;
 }
 
 /*
- * midpoint between two points
- * TODO: move somewhere else
+ * puts the point with the given key on the edge into the target at the given
+ * dot, unless that dot has already been filled. Occlusion is only calculated
+ * for the point if the edge is partially occluded, in which case the point
+ * waits in pend until a block of them can be tested at once
  */
 static
 void
-midpoint(point3 *p0, point3 *p1, point3 *mp)
+plot_point(struct shape *s, struct raster_target *tgt, uint32_t key,
+	   long dotx, long doty, point3 *p, struct edge *edge,
+	   enum edge_occlusion state, struct pending *pend)
 {
-	mp->x = (p0->x + p1->x) / 2;
-	mp->y = (p0->y + p1->y) / 2;
-	mp->z = (p0->z + p1->z) / 2;
+	int n;
+	size_t slot;
+	uint16_t *cell, dot;
+
+	/*
+	 * only worry about points that are on screen and that don't overlap
+	 * with previous points
+	 */
+	cell = free_dot(s, tgt, dotx, doty, key, &dot, &slot);
+	if (cell == NULL) {
+		return;
+	}
+
+	if (state != PARTIAL) {
+		mark_dot(s, tgt, cell, dot, slot, key, state);
+		return;
+	}
+
+	n = pend->points.n;
+	if (n > 0 && pend->dotx[n - 1] == dotx && pend->doty[n - 1] == doty) {
+		if (hides_points(s)) {
+			pend->follows[pend->more.n] = n - 1;
+			block_add(&(pend->more), p);
+		}
+	} else {
+		pend->dotx[n] = dotx;
+		pend->doty[n] = doty;
+		pend->key[n] = key;
+		block_add(&(pend->points), p);
+	}
+
+	if (pend->points.n == OCC_BLOCK || pend->more.n == OCC_BLOCK) {
+		flush_points(s, tgt, edge, pend);
+	}
 }
 
 /*
- * prints the edges by calculating the normal vector from two given points, and
- * then prints points along the edge by multiplying the normal
+ * occlusion state of the point at t along an edge. For ANALYTIC occlusion the
+ * hidden intervals of a partially hidden edge are already known, and t only
+ * increases along the edge, so k walks through them once per edge
  */
 static
+enum edge_occlusion
+point_state(struct shape *s, struct edge_hidden *h, double t, int *k)
+{
+	if (h->state != PARTIAL || s->occlusion != ANALYTIC) {
+		return h->state;
+	}
+
+	while (*k < h->n && h->hidden[*k].end < t) {
+		++*k;
+	}
+
+	return *k < h->n && h->hidden[*k].start <= t ? BOTH : NEITHER;
+}
+
+/*
+ * finds the point a fraction t along an edge, where v goes from its first
+ * vertex to its second. The last point is the second vertex itself, since
+ * adding all of v to the first can round to a point just off of it, and
+ * occlusion tells a point on a vertex from one next to it
+ */
+static inline
 void
-print_edges(struct shape *s)
+edge_point(struct shape *s, struct edge *edge, point3 *v, double t, point3 *p)
+{
+	point3 *p0;
+
+	if (t == 1) {
+		*p = s->vertices[edge->edge[1]];
+		return;
+	}
+
+	p0 = &(s->vertices[edge->edge[0]]);
+	p->x = p0->x + t * v->x;
+	p->y = p0->y + t * v->y;
+	p->z = p0->z + t * v->z;
+}
+
+/*
+ * legacy rasterizer: evaluates e_density + 1 evenly spaced points along the
+ * edge in 3D and projects each one on to the screen
+ *
+ * e_density is a natural number directly corresponding to the number of
+ * points printed along the edge. Only points from up to to are drawn, and
+ * point k has the key base + k
+ */
+static
+void
+sample_edge(struct shape *s, struct raster_target *tgt, struct edge *edge,
+	    struct edge_hidden *h, uint32_t base, long from, long to)
 {
-	char occlude_val;
-	ssize_t fronts_index, behinds_index, found_front, found_behind;
-	int i, k, winx, winy;
-	double x0, y0, z0, v_len, x, y, z, movex, movey;
-	point3 v, u;
-	enum edge_occlusion edge_occlude_state;
-	enum t_pixel_print tpp;
-	struct point_to_print test_point;
+	int k, hidden;
+	double t;
+	point3 *p0, *a, *b, v, p;
+	struct pending pend;
 
-	getmaxyx(stdscr, winy, winx);
+	hidden = 0;
+	pend.points.n = 0;
+	pend.more.n = 0;
+	p0 = &(s->vertices[edge->edge[0]]);
 
-	fronts_index = 0;
-	behinds_index = 0;
+	/* v is the vector given by two points */
+	vector3_sub(&(s->vertices[edge->edge[1]]), p0, &v);
 
-	/* iterates over the edges */
-	for (i = s->num_e - 1; i >= 0; --i) {
-		v = s->vertices[s->edges[i].edge[0]];
-		x0 = v.x;
-		y0 = v.y;
-		z0 = v.z;
-
-		/* v is the vector given by two points */
-		vector3_sub(&(s->vertices[s->edges[i].edge[1]]),
-			    &(s->vertices[s->edges[i].edge[0]]),
-			    &v);
-		v_len = vector3_mag(&v);
-
-		/* u is the unit vector from v */
-		vector3_unit(&v, &u);
-
-		/*
-		 * if both vertices are occluded, then all the points in
-		 * between are occluded.
-		 *
-		 * if neither vertices are occluded, then none of the points in
-		 * betwen are occluded
-		 *
-		 * if one vertex is occluded and the other is not occluded,
-		 * then do the occlusion calculation on every point on the edge
-		 */
-		edge_occlude_state = PARTIAL;
-
-		if (s->occlusion == CONVEX ||
-		    s->occlusion == CONVEX_CLEAR) {
-			int occ0, occ1, occ_mp;
-			point3 *p0, *p1;
-			point3 mp;
-
-			p0 = &(s->vertices[s->edges[i].edge[0]]);
-			p1 = &(s->vertices[s->edges[i].edge[1]]);
-
-			occ0 = occlude_point_convex(s, p0, &(s->edges[i]));
-			occ1 = occlude_point_convex(s, p1, &(s->edges[i]));
-
-			if (occ0 == 0 && occ1 == 0) {
-				midpoint(p0, p1, &mp);
-				occ_mp = occlude_point_convex(s, &mp, &(s->edges[i]));
-				if (occ_mp == 0) {
-					edge_occlude_state = NEITHER;
-				}
-			} else if (occ0 == 1 && occ1 == 1) {
-				edge_occlude_state = BOTH;
-			}
+	/* the projection is affine, so points between project between these */
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+
+	for (k = (int) from; k <= s->e_density && k < to; ++k) {
+		t = k / (double) s->e_density;
+
+		edge_point(s, edge, &v, t, &p);
+
+		plot_point(s, tgt, base + k,
+			   (long) floor(a->x + t * (b->x - a->x)),
+			   (long) floor(a->y + t * (b->y - a->y)),
+			   &p, edge, point_state(s, h, t, &hidden), &pend);
+	}
+
+	flush_points(s, tgt, edge, &pend);
+}
+
+/*
+ * first dot of an edge in the grid of dots, and how far its last dot is from
+ * it along both axes
+ *
+ * returns the number of steps along the longer axis
+ */
+static
+long
+dda_steps(struct shape *s, struct edge *edge, long *x0, long *y0, long *dx,
+	  long *dy)
+{
+	point3 *a, *b;
+
+	/* endpoints in dot coordinates */
+	a = &(s->screen[edge->edge[0]]);
+	b = &(s->screen[edge->edge[1]]);
+
+	*x0 = (long) floor(a->x);
+	*y0 = (long) floor(a->y);
+	*dx = (long) floor(b->x) - *x0;
+	*dy = (long) floor(b->y) - *y0;
+
+	return labs(*dx) > labs(*dy) ? labs(*dx) : labs(*dy);
+}
+
+/*
+ * screen space rasterizer: projects the two endpoints of the edge once and
+ * steps along the line in the grid of dots (half cells, which are one column
+ * wide and half a row high, or braille dots), visiting each dot on the line
+ * exactly once. Either kind of dot is roughly square on a terminal
+ *
+ * the position at step i is computed with integer arithmetic as the rounded
+ * value of start + i * delta / n along both axes, where n is the number of
+ * steps along the longer axis. Only steps from up to to are drawn, and step i
+ * has the key base + i
+ */
+static
+void
+dda_edge(struct shape *s, struct raster_target *tgt, struct edge *edge,
+	 struct edge_hidden *h, uint32_t base, long from, long to)
+{
+	long i, n, x0, y0, dx, dy, x, y;
+	int hidden;
+	double t;
+	point3 *p0, v, p;
+	struct pending pend;
+
+	hidden = 0;
+	pend.points.n = 0;
+	pend.more.n = 0;
+	p0 = &(s->vertices[edge->edge[0]]);
+	vector3_sub(&(s->vertices[edge->edge[1]]), p0, &v);
+
+	n = dda_steps(s, edge, &x0, &y0, &dx, &dy);
+
+	for (i = from; i <= n && i < to; ++i) {
+		if (n == 0) {
+			x = x0;
+			y = y0;
+			t = 0;
+		} else {
+			x = x0 + floor_div(2 * i * dx + n, 2 * n);
+			y = y0 + floor_div(2 * i * dy + n, 2 * n);
+			t = i / (double) n;
 		}
 
+		/* the point on the edge in 3D that this step corresponds to */
+		edge_point(s, edge, &v, t, &p);
 
-		/*
-		 * prints points along the edge
-		 *
-		 * e_density is a natural number directly corresponding to the
-		 * number of points printed along the edge
-		 */
-		for (k = 0; k <= s->e_density; ++k) {
-			x = x0 + ((k / (double) s->e_density * v_len) * u.x);
-			y = y0 + ((k / (double) s->e_density * v_len) * u.y);
-			z = z0 + ((k / (double) s->e_density * v_len) * u.z);
-
-			movex = x;
-			movey = y;
-			tpp = movexy(&movex, &movey);
-
-			/*
- 			 * only worry about points that are on screen and that
- 			 * don't overlap with previous points
-			 */
-			if ((int) movex < 0 || (int) movex > winx ||
-			    (int) movey < 0 || (int) movey > winy) {
-				continue;
-			}
+		plot_point(s, tgt, base + (uint32_t) i, x, y, &p, edge,
+			   point_state(s, h, t, &hidden), &pend);
+	}
 
-			test_point.x = movex;
-			test_point.y = movey;
-			test_point.t = tpp;
+	flush_points(s, tgt, edge, &pend);
+}
 
-			found_front = search_ptp(s->fronts, fronts_index, &test_point);
-			if (found_front == -1) {
-				continue;
-			}
+/*
+ * determines how much of an edge is occluded before rasterizing it
+ *
+ * for convex solids the edge was already classified from its faces for the
+ * frame: it's visible if it's in front or on the silhouette, and occluded if
+ * it's behind. That doesn't hold for a solid that isn't convex, where a face
+ * can hide an edge whose faces face the center of projection
+ *
+ * other edges are tested at their vertices instead. If both
+ * vertices are occluded, then all the points in between are occluded.
+ *
+ * if neither vertices are occluded, then none of the points in betwen are
+ * occluded
+ *
+ * if one vertex is occluded and the other is not occluded, then do the
+ * occlusion calculation on every point on the edge
+ *
+ * for ANALYTIC occlusion the hidden intervals of the edge have to be found up
+ * front into the scratch sc by hl_edge(), and the edge is only partially
+ * occluded if they don't cover all of it
+ */
+static
+enum edge_occlusion
+edge_occlusion_state(struct shape *s, struct edge *edge, struct hl_scratch *sc)
+{
+	uint64_t mask;
+	point3 *p0, *p1;
+	point3 mp;
+	struct point_block b;
+
+	if (s->occlusion == ANALYTIC) {
+		if (sc->num_hidden == 0) {
+			return NEITHER;
+		} else if (sc->num_hidden == 1 && sc->hidden[0].start <= 0 &&
+			   sc->hidden[0].end >= 1) {
+			return BOTH;
+		}
 
-			found_behind = search_ptp(s->behinds, behinds_index, &test_point);
-			if (found_behind == -1) {
-				continue;
-			}
+		return PARTIAL;
+	}
+
+	if (s->occlusion != CONVEX && s->occlusion != CONVEX_CLEAR) {
+		return PARTIAL;
+	}
+
+	if (s->convex && edge->face[0] >= 0) {
+		return edge->side == EDGE_BACK ? BOTH : NEITHER;
+	}
+
+	p0 = &(s->vertices[edge->edge[0]]);
+	p1 = &(s->vertices[edge->edge[1]]);
+
+	/* both vertices are tested as one block */
+	b.n = 0;
+	block_add(&b, p0);
+	block_add(&b, p1);
+
+	mask = occlude_block_convex(s, &b, edge);
+
+	if (mask == 0) {
+		midpoint(p0, p1, &mp);
+
+		b.n = 0;
+		block_add(&b, &mp);
+
+		if (occlude_block_convex(s, &b, edge) == 0) {
+			return NEITHER;
+		}
+	} else if (mask == 3) {
+		return BOTH;
+	}
+
+	return PARTIAL;
+}
+
+/*
+ * draws points from up to to of an edge into the target with the chosen
+ * raster method, with the first point of the edge having the key base
+ */
+static
+void
+draw_edge(struct shape *s, struct raster_target *tgt, struct edge *edge,
+	  struct edge_hidden *h, uint32_t base, long from, long to)
+{
+	switch (s->raster) {
+	case SAMPLE:
+		sample_edge(s, tgt, edge, h, base, from, to);
+		break;
+
+	case DDA:
+		dda_edge(s, tgt, edge, h, base, from, to);
+		break;
+	}
+}
+
+/*
+ * number of points the chosen raster method draws along an edge
+ */
+static
+long
+edge_points(struct shape *s, struct edge *edge)
+{
+	long x0, y0, dx, dy;
+
+	switch (s->raster) {
+	case SAMPLE:
+		return s->e_density + 1;
+
+	case DDA:
+		return dda_steps(s, edge, &x0, &y0, &dx, &dy) + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * range of edges thread i of the pool finds the state of. Telling that costs
+ * about the same for every edge, so the edges are just split into ranges of
+ * the same size
+ */
+static
+void
+edge_range(struct shape *s, int i, int *first, int *end)
+{
+	int n;
+
+	n = s->pool->num_threads;
+	*first = (int) ((long) s->num_e * i / n);
+	*end = (int) ((long) s->num_e * (i + 1) / n);
+}
+
+/*
+ * finds how much of the edges in the range of thread i of the pool are
+ * hidden. For ANALYTIC occlusion the hidden intervals are found in the
+ * scratch of the thread and kept in the pool until gather_hidden(), and if
+ * that fails the pool is marked as failed
+ */
+static
+void
+edge_state_range(struct shape *s, int i)
+{
+	int e, first, end;
+	struct hl_scratch *sc;
+	struct raster_pool *pool;
+
+	pool = s->pool;
+	sc = s->occlusion == ANALYTIC ? &(s->hl->scratch[i]) : NULL;
+
+	edge_range(s, i, &first, &end);
+	for (e = first; e < end; ++e) {
+		if (sc != NULL && (hl_edge(s, &(s->edges[e]), sc) != 0 ||
+				   raster_pool_add_found(pool, i, e, sc->hidden,
+							 sc->num_hidden) != 0)) {
+			pool->found[i].failed = 1;
+			return;
+		}
+
+		pool->state[e] = edge_occlusion_state(s, &(s->edges[e]), sc);
+	}
+}
+
+/*
+ * caches the hidden intervals the threads found and copies the ones of
+ * PARTIAL edges to where the threads draw them from. Caching isn't safe while
+ * the threads are finding intervals, so it's done after, on one thread
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+static
+int
+gather_hidden(struct shape *s)
+{
+	int i, e, n, first, end;
+	struct interval *hidden;
+	struct raster_found *found;
+	struct raster_pool *pool;
+
+	pool = s->pool;
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		found = &(pool->found[i]);
+		if (found->failed) {
+			return -1;
+		}
+
+		edge_range(s, i, &first, &end);
+		for (e = first; e < end; ++e) {
+			n = pool->hidden_count[e];
+			hidden = n > 0 ? &(found->hidden[pool->hidden_first[e]]) :
+				 NULL;
+
+			hl_cache_edge(s, &(s->edges[e]), hidden, n);
 
-			/*
-			 * if the occlusion flag is set and a point shouldn't
-			 * be occluded, the rest of the loop prints the point
-			 */
-			if (edge_occlude_state == PARTIAL) {
-				occlude_val = occlude_point(s,
-						&((point3) {x, y, z}),
-						&(s->edges[i]));
-			} else {
-				occlude_val = edge_occlude_state;
+			if (raster_pool_add_hidden(pool, e, hidden,
+						   pool->state[e] == PARTIAL ?
+						   n : 0) != 0) {
+				return -1;
 			}
+		}
+	}
 
-			if (s->occlusion == CONVEX && occlude_val) {
-				continue;
+	return 0;
+}
+
+/*
+ * draws tasks into the cells of thread i of the pool until there are none
+ * left
+ */
+static
+void
+draw_tasks(struct shape *s, int i)
+{
+	int t, k, e;
+	struct raster_pool *pool;
+	struct raster_task *task;
+	struct raster_target tgt;
+	struct edge_hidden h;
+
+	pool = s->pool;
+	tgt.cells = &(pool->cells[i * pool->num_cells]);
+	tgt.keys = &(pool->keys[i * pool->num_dots]);
+	tgt.touched = &(pool->touched[i * pool->rows]);
+
+	while ((t = raster_pool_take(pool, i)) >= 0) {
+		task = &(pool->tasks[t]);
+
+		for (k = task->first; k < task->end; ++k) {
+			e = s->num_e - 1 - k;
+
+			h.state = pool->state[e];
+			h.n = s->occlusion == ANALYTIC ? pool->hidden_count[e] : 0;
+			h.hidden = h.n > 0 ?
+				   &(pool->hidden[pool->hidden_first[e]]) : NULL;
+
+			draw_edge(s, &tgt, &(s->edges[e]), &h, pool->base[k],
+				  task->from, task->to);
+		}
+	}
+}
+
+/*
+ * cuts the edges into tasks in the order they're drawn in (from the last one
+ * down), giving every point its key. A PARTIAL edge is split into tasks of
+ * RASTER_TASK_SAMPLES points, and the edges between PARTIAL ones are batched
+ *
+ * returns 0 on success, -1 if an allocation failed or there are too many
+ * points for the keys
+ */
+static
+int
+make_tasks(struct shape *s)
+{
+	int k, e, batch;
+	long n, from;
+	uint64_t key;
+	struct raster_pool *pool;
+
+	pool = s->pool;
+	key = 0;
+	batch = -1;
+
+	for (k = 0; k < s->num_e; ++k) {
+		e = s->num_e - 1 - k;
+		n = edge_points(s, &(s->edges[e]));
+
+		if (key + n > RASTER_NO_KEY) {
+			return -1;
+		}
+
+		pool->base[k] = (uint32_t) key;
+		key += n;
+
+		if (pool->state[e] != PARTIAL) {
+			if (batch < 0) {
+				batch = k;
 			}
 
-			/*
-			 * renders the rear and front symbols based on whether
-			 * the point is detected to be "behind" or "in front"
-			 */
-#if USE_NCURSES
-			if (occlude_val == 1) {
-				s->behinds[behinds_index].x = movex;
-				s->behinds[behinds_index].y = movey;
-				if (found_behind >= 0) {
-					s->behinds[behinds_index].t = FULL;
-				} else {
-					s->behinds[behinds_index].t = tpp;
-				}
-				behinds_index++;
-			} else {
-				s->fronts[fronts_index].x = movex;
-				s->fronts[fronts_index].y = movey;
-				if (found_front >= 0) {
-					s->fronts[fronts_index].t = FULL;
-				} else {
-					s->fronts[fronts_index].t = tpp;
+			if (k + 1 - batch == RASTER_TASK_EDGES) {
+				if (raster_pool_add_task(pool, batch, k + 1, 0,
+							 LONG_MAX) != 0) {
+					return -1;
 				}
-				fronts_index++;
+
+				batch = -1;
+			}
+
+			continue;
+		}
+
+		if (batch >= 0 &&
+		    raster_pool_add_task(pool, batch, k, 0, LONG_MAX) != 0) {
+			return -1;
+		}
+
+		batch = -1;
+
+		for (from = 0; from < n; from += RASTER_TASK_SAMPLES) {
+			if (raster_pool_add_task(pool, k, k + 1, from,
+						 from + RASTER_TASK_SAMPLES) != 0) {
+				return -1;
 			}
-#endif
 		}
 	}
 
-#if USE_NCURSES
-	/* print all the points behind */
-	attron(A_DIM);
-	if (s->occlusion != CONVEX) {
-		for (ssize_t j = 0; j < behinds_index - 1; ++j) {
-			mvprintw(s->behinds[j].y,
-				 s->behinds[j].x,
-				 "%c", s->behinds[j].t);
+	if (batch >= 0 &&
+	    raster_pool_add_task(pool, batch, s->num_e, 0, LONG_MAX) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rasterizes every edge with the threads of the pool, starting them first if
+ * the number of threads changed
+ *
+ * returns 0 on success, -1 if the threads couldn't be started or an
+ * allocation failed, in which case nothing was drawn
+ */
+static
+int
+print_edges_threaded(struct shape *s)
+{
+	if (s->pool == NULL || s->pool->num_threads != s->threads) {
+		raster_pool_destroy(s->pool);
+
+		s->pool = raster_pool_create(s->threads);
+		if (s->pool == NULL) {
+			return -1;
 		}
 	}
-	attroff(A_DIM);
 
-	/* print all the points in front */
-	attron(A_BOLD);
-	for (ssize_t j = 0; j < fronts_index - 1; ++j) {
-		mvprintw(s->fronts[j].y,
-			 s->fronts[j].x,
-			 "%c", s->fronts[j].t);
+	if (raster_pool_reserve(s->pool, s->fb->rows, s->fb->cols,
+				s->view.dots_x * s->view.dots_y,
+				s->num_e) != 0) {
+		return -1;
+	}
+
+	raster_pool_run(s->pool, s, edge_state_range);
+
+	if (s->occlusion == ANALYTIC && gather_hidden(s) != 0) {
+		return -1;
+	}
+
+	if (make_tasks(s) != 0) {
+		return -1;
+	}
+
+	raster_pool_deal(s->pool);
+	raster_pool_run(s->pool, s, draw_tasks);
+	raster_pool_merge(s->pool, s->fb->cells, s->pixels);
+
+	return 0;
+}
+
+/*
+ * rasterizes every edge into the framebuffer with the chosen raster method,
+ * on s->threads threads
+ */
+static
+void
+print_edges(struct shape *s)
+{
+	int i;
+	struct edge_hidden h;
+	struct hl_scratch *sc;
+	struct raster_target tgt;
+
+	if (s->threads > 1 && print_edges_threaded(s) == 0) {
+		return;
+	}
+
+	tgt.cells = s->fb->cells;
+	tgt.keys = NULL;
+	tgt.touched = NULL;
+
+	sc = s->occlusion == ANALYTIC ? &(s->hl->scratch[0]) : NULL;
+
+	/* iterates over the edges */
+	for (i = s->num_e - 1; i >= 0; --i) {
+		if (sc != NULL && hl_edge(s, &(s->edges[i]), sc) == 0) {
+			hl_cache_edge(s, &(s->edges[i]), sc->hidden,
+				      sc->num_hidden);
+		}
+
+		h.state = edge_occlusion_state(s, &(s->edges[i]), sc);
+		h.hidden = sc != NULL ? sc->hidden : NULL;
+		h.n = sc != NULL ? sc->num_hidden : 0;
+
+		draw_edge(s, &tgt, &(s->edges[i]), &h, 0, 0, LONG_MAX);
 	}
-	attroff(A_BOLD);
-#endif
 }
 
 /*
@@ -270,38 +865,97 @@ static
 void
 print_vertices(struct shape *s)
 {
-	int i;
-	double x, y, z;
-
+	int i, k, first;
+	uint64_t mask;
 	struct edge edge;
+	struct point_block b;
 
 	/* specifically invalid edge */
 	edge.edge[0] = -1;
 	edge.edge[1] = -1;
+	edge.face[0] = -1;
+	edge.face[1] = -1;
+	edge.num_faces = 0;
+
+	/* the vertices are tested for occlusion a block at a time */
+	for (first = s->num_v - 1; first >= 0; first -= OCC_BLOCK) {
+		b.n = 0;
+		for (i = first; i >= 0 && i > first - OCC_BLOCK; --i) {
+			block_add(&b, &(s->vertices[i]));
+		}
 
-	for (i = s->num_v - 1; i >= 0; --i) {
-		x = s->vertices[i].x;
-		y = s->vertices[i].y;
-		z = s->vertices[i].z;
+		mask = s->occlusion ? occlude_block(s, &b, &edge) : 0;
 
-		if (s->occlusion &&
-			occlude_point(s, &((point3) {x, y, z}), &edge)) {
-			continue;
-		}
+		for (k = 0; k < b.n; ++k) {
+			if ((mask >> k) & 1) {
+				continue;
+			}
 
-		movexy(&x, &y);
-#if USE_NCURSES
-		mvprintw(y, x, "%i", i);
-#endif
+			i = first - k;
+			present_text(s,
+				     (int) floor(s->screen[i].y / s->view.dots_y),
+				     (int) floor(s->screen[i].x / s->view.dots_x),
+				     "%i", i);
+		}
 	}
 }
 
 /*
- * only prints edges if edges are stored in the shape struct
+ * draws the frame into the framebuffer, with the vertex labels over it, for
+ * present_frame() to present. Only prints edges if edges are stored in the
+ * shape struct
  */
 void
 print_shape(struct shape *s)
 {
+	int winx, winy;
+
+	s->backend->size(s->backend, &winy, &winx);
+
+	if (fb_resize(s->fb, winy, winx) != 0) {
+		return;
+	}
+
+	/*
+	 * every vertex is placed and projected once for the frame, so edges,
+	 * labels, and occlusion all read the same positions
+	 */
+	viewport_update(s);
+	apply_model(s);
+
+	fb_clear(s->fb);
+
+	/* faces have to be in the depth buffer before any point is tested */
+	if ((s->occlusion == EXACT || s->fill) && zb_render(s) != 0) {
+		return;
+	}
+
+	if (s->fill) {
+		shade_faces(s);
+	}
+
+	/* edge labels go stale while they aren't being kept up to date */
+	if (s->occlusion == CONVEX || s->occlusion == CONVEX_CLEAR) {
+		/* only rays use the hierarchy, so it's only refit for them */
+		if (s->moved) {
+			refit_bvh(s);
+			s->moved = 0;
+		}
+
+		project_faces(s);
+
+		/* the labels only tell what's seen on a convex solid */
+		if (s->convex) {
+			classify_edges(s);
+		}
+	} else {
+		s->sides_valid = 0;
+	}
+
+	if (s->occlusion == ANALYTIC && hl_prepare(s) != 0) {
+		return;
+	}
+
 	if (s->print_edges && s->num_e) {
 		print_edges(s);
 	}
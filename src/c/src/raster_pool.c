@@ -0,0 +1,641 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "raster_pool.h"
+#include "framebuffer.h"
+#include "hidden_line.h"
+#include "print.h"
+#include "term_shapes.h"
+
+/*
+ * runs the job of thread i, adding the CPU time it took to the busy time of
+ * the thread
+ */
+static
+void
+run_job(struct raster_pool *pool, int i)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	pool->job(pool->s, i);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+	pool->busy[i] += (end.tv_sec - start.tv_sec) * 1000000000L +
+			 end.tv_nsec - start.tv_nsec;
+}
+
+/*
+ * waits for frames to be posted and runs the job of the thread in each,
+ * until the pool ends
+ */
+static
+void *
+raster_thread_main(void *arg)
+{
+	unsigned long frame;
+	struct raster_thread *t;
+	struct raster_pool *pool;
+
+	t = arg;
+	pool = t->pool;
+	frame = 0;
+
+	pthread_mutex_lock(&(pool->lock));
+
+	while (1) {
+		while (!pool->quit && pool->frame == frame) {
+			pthread_cond_wait(&(pool->work), &(pool->lock));
+		}
+
+		if (pool->quit) {
+			break;
+		}
+
+		frame = pool->frame;
+		pthread_mutex_unlock(&(pool->lock));
+
+		run_job(pool, t->index);
+
+		pthread_mutex_lock(&(pool->lock));
+		if (--pool->running == 0) {
+			pthread_cond_signal(&(pool->done));
+		}
+	}
+
+	pthread_mutex_unlock(&(pool->lock));
+
+	return NULL;
+}
+
+/*
+ * stops the first n threads of the pool and frees it
+ */
+static
+void
+stop_threads(struct raster_pool *pool, int n)
+{
+	int i;
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->quit = 1;
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+
+	for (i = 0; i < n; ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&(pool->done));
+	pthread_cond_destroy(&(pool->work));
+	pthread_mutex_destroy(&(pool->lock));
+
+	free(pool->threads);
+	free(pool->args);
+	free(pool->cells);
+	free(pool->keys);
+	free(pool->touched);
+	free(pool->tasks);
+	free(pool->deques);
+	free(pool->busy);
+	free(pool->steals);
+	free(pool->state);
+	free(pool->hidden_first);
+	free(pool->hidden_count);
+	free(pool->hidden);
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		free(pool->found[i].hidden);
+	}
+
+	free(pool->found);
+	free(pool->base);
+	free(pool);
+}
+
+/*
+ * starts a pool of num_threads threads, counting the thread that will post
+ * frames to it, so num_threads - 1 are started
+ *
+ * returns NULL if the threads couldn't be started
+ */
+struct raster_pool *
+raster_pool_create(int num_threads)
+{
+	int i;
+	struct raster_pool *pool;
+
+	pool = malloc(sizeof(struct raster_pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->num_threads = num_threads;
+	pool->threads = malloc(sizeof(pthread_t) * num_threads);
+	pool->args = malloc(sizeof(struct raster_thread) * num_threads);
+	pool->frame = 0;
+	pool->running = 0;
+	pool->quit = 0;
+	pool->job = NULL;
+	pool->s = NULL;
+	pool->cells = NULL;
+	pool->num_cells = 0;
+	pool->max_cells = 0;
+	pool->keys = NULL;
+	pool->num_dots = 0;
+	pool->max_dots = 0;
+	pool->touched = NULL;
+	pool->rows = 0;
+	pool->cols = 0;
+	pool->max_touched = 0;
+	pool->tasks = NULL;
+	pool->num_tasks = 0;
+	pool->max_tasks = 0;
+	pool->deques = malloc(sizeof(struct raster_deque) * num_threads);
+	pool->busy = calloc(num_threads, sizeof(long));
+	pool->steals = calloc(num_threads, sizeof(int));
+	pool->state = NULL;
+	pool->hidden_first = NULL;
+	pool->hidden_count = NULL;
+	pool->max_edges = 0;
+	pool->hidden = NULL;
+	pool->num_hidden = 0;
+	pool->max_hidden = 0;
+	pool->found = calloc(num_threads, sizeof(struct raster_found));
+	pool->base = NULL;
+
+	if (pool->threads == NULL || pool->args == NULL ||
+	    pool->deques == NULL || pool->busy == NULL || pool->steals == NULL ||
+	    pool->found == NULL) {
+		free(pool->threads);
+		free(pool->args);
+		free(pool->deques);
+		free(pool->busy);
+		free(pool->steals);
+		free(pool->found);
+		free(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < num_threads; ++i) {
+		atomic_init(&(pool->deques[i].range), 0);
+	}
+
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_cond_init(&(pool->work), NULL);
+	pthread_cond_init(&(pool->done), NULL);
+
+	for (i = 1; i < num_threads; ++i) {
+		pool->args[i].pool = pool;
+		pool->args[i].index = i;
+
+		if (pthread_create(&(pool->threads[i - 1]), NULL,
+				   raster_thread_main, &(pool->args[i])) != 0) {
+			stop_threads(pool, i - 1);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/*
+ * makes room for the cells and keys of every thread for a screen of
+ * rows * cols cells of dots dots each, and for num_e edges, and starts a new
+ * frame with no tasks. Nothing is shrunk. If the screen changed, the cells
+ * and keys are laid out differently, so all of them are emptied
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+int
+raster_pool_reserve(struct raster_pool *pool, int rows, int cols, int dots,
+		    int num_e)
+{
+	int i;
+	size_t n;
+	uint8_t *touched;
+	uint16_t *cells;
+	uint32_t *keys, *base;
+	enum edge_occlusion *state;
+	int *first, *count;
+
+	if (pool->rows != rows || pool->cols != cols ||
+	    pool->num_dots != (size_t) rows * cols * dots) {
+		/* nothing is drawn if an allocation below fails */
+		pool->rows = 0;
+		pool->cols = 0;
+		pool->num_cells = 0;
+		pool->num_dots = 0;
+
+		n = (size_t) rows * pool->num_threads;
+		if (n > pool->max_touched) {
+			touched = realloc(pool->touched, n);
+			if (touched == NULL) {
+				return -1;
+			}
+
+			pool->touched = touched;
+			pool->max_touched = n;
+		}
+
+		n = (size_t) rows * cols * pool->num_threads;
+		if (n > pool->max_cells) {
+			cells = realloc(pool->cells, sizeof(uint16_t) * n);
+			if (cells == NULL) {
+				return -1;
+			}
+
+			pool->cells = cells;
+			pool->max_cells = n;
+		}
+
+		n *= dots;
+		if (n > pool->max_dots) {
+			keys = realloc(pool->keys, sizeof(uint32_t) * n);
+			if (keys == NULL) {
+				return -1;
+			}
+
+			pool->keys = keys;
+			pool->max_dots = n;
+		}
+
+		pool->rows = rows;
+		pool->cols = cols;
+		pool->num_cells = (size_t) rows * cols;
+		pool->num_dots = pool->num_cells * dots;
+
+		memset(pool->touched, 0, (size_t) rows * pool->num_threads);
+		memset(pool->cells, 0,
+		       sizeof(uint16_t) * pool->num_cells * pool->num_threads);
+		memset(pool->keys, 0xff,
+		       sizeof(uint32_t) * pool->num_dots * pool->num_threads);
+	}
+
+	if (num_e > pool->max_edges) {
+		state = realloc(pool->state, sizeof(enum edge_occlusion) * num_e);
+		if (state == NULL) {
+			return -1;
+		}
+
+		pool->state = state;
+
+		first = realloc(pool->hidden_first, sizeof(int) * num_e);
+		if (first == NULL) {
+			return -1;
+		}
+
+		pool->hidden_first = first;
+
+		count = realloc(pool->hidden_count, sizeof(int) * num_e);
+		if (count == NULL) {
+			return -1;
+		}
+
+		pool->hidden_count = count;
+
+		base = realloc(pool->base, sizeof(uint32_t) * num_e);
+		if (base == NULL) {
+			return -1;
+		}
+
+		pool->base = base;
+		pool->max_edges = num_e;
+	}
+
+	pool->num_hidden = 0;
+	pool->num_tasks = 0;
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		pool->busy[i] = 0;
+		pool->steals[i] = 0;
+		pool->found[i].num = 0;
+		pool->found[i].failed = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * copies n intervals to the end of the list of *num of them, which has room
+ * for *max
+ *
+ * returns where they start in the list, or -1 if the allocation failed
+ */
+static
+int
+append_intervals(struct interval **list, int *num, int *max,
+		 struct interval *hidden, int n)
+{
+	int first, size;
+	struct interval *copy;
+
+	if (*num + n > *max) {
+		size = *max ? 2 * *max : 64;
+		size = size < *num + n ? *num + n : size;
+
+		copy = realloc(*list, sizeof(struct interval) * size);
+		if (copy == NULL) {
+			return -1;
+		}
+
+		*list = copy;
+		*max = size;
+	}
+
+	if (n > 0) {
+		memcpy(&((*list)[*num]), hidden, sizeof(struct interval) * n);
+	}
+
+	first = *num;
+	*num += n;
+
+	return first;
+}
+
+/*
+ * keeps a copy of the n hidden intervals of edge e that thread i found, until
+ * they're gathered with raster_pool_add_hidden()
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+int
+raster_pool_add_found(struct raster_pool *pool, int i, int e,
+		      struct interval *hidden, int n)
+{
+	struct raster_found *found;
+
+	found = &(pool->found[i]);
+
+	pool->hidden_first[e] = append_intervals(&(found->hidden),
+						 &(found->num), &(found->max),
+						 hidden, n);
+	pool->hidden_count[e] = n;
+
+	if (pool->hidden_first[e] < 0) {
+		found->failed = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * keeps a copy of the n hidden intervals of edge e for the threads to draw
+ * it from
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+int
+raster_pool_add_hidden(struct raster_pool *pool, int e,
+		       struct interval *hidden, int n)
+{
+	pool->hidden_first[e] = append_intervals(&(pool->hidden),
+						 &(pool->num_hidden),
+						 &(pool->max_hidden),
+						 hidden, n);
+	pool->hidden_count[e] = n;
+
+	return pool->hidden_first[e] < 0 ? -1 : 0;
+}
+
+/*
+ * adds a task for the frame
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+int
+raster_pool_add_task(struct raster_pool *pool, int first, int end, long from,
+		     long to)
+{
+	int max;
+	struct raster_task *tasks, *t;
+
+	if (pool->num_tasks == pool->max_tasks) {
+		max = pool->max_tasks ? 2 * pool->max_tasks : 256;
+
+		tasks = realloc(pool->tasks, sizeof(struct raster_task) * max);
+		if (tasks == NULL) {
+			return -1;
+		}
+
+		pool->tasks = tasks;
+		pool->max_tasks = max;
+	}
+
+	t = &(pool->tasks[pool->num_tasks++]);
+	t->first = first;
+	t->end = end;
+	t->from = from;
+	t->to = to;
+
+	return 0;
+}
+
+/*
+ * deals the tasks of the frame out to the threads, as one run of about the
+ * same number of tasks each, in order. Tasks next to each other are usually
+ * near each other on the screen, so a thread mostly draws into the same part
+ * of its cells
+ */
+void
+raster_pool_deal(struct raster_pool *pool)
+{
+	int i;
+	uint64_t front, back;
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		front = (uint64_t) pool->num_tasks * i / pool->num_threads;
+		back = (uint64_t) pool->num_tasks * (i + 1) / pool->num_threads;
+
+		atomic_store(&(pool->deques[i].range), front | back << 32);
+	}
+}
+
+/*
+ * takes the task at the front of a deque, or the one at the back if steal
+ *
+ * returns the index of the task, or -1 if the deque is empty
+ */
+static
+int
+take_task(struct raster_deque *d, int steal)
+{
+	uint64_t range, next;
+	uint32_t front, back;
+
+	range = atomic_load(&(d->range));
+
+	do {
+		front = (uint32_t) range;
+		back = (uint32_t) (range >> 32);
+
+		if (front >= back) {
+			return -1;
+		}
+
+		next = steal ? range - ((uint64_t) 1 << 32) : range + 1;
+	} while (!atomic_compare_exchange_weak(&(d->range), &range, next));
+
+	return steal ? (int) back - 1 : (int) front;
+}
+
+/*
+ * next task for thread i to draw: the next of its own, or else one stolen
+ * from the back of another thread's, trying them in turn from the one after
+ * it. No tasks are added while the threads are drawing, so once every deque
+ * is empty the thread is done
+ *
+ * returns the index of the task, or -1 if there are none left
+ */
+int
+raster_pool_take(struct raster_pool *pool, int i)
+{
+	int k, t;
+
+	t = take_task(&(pool->deques[i]), 0);
+	if (t >= 0) {
+		return t;
+	}
+
+	for (k = 1; k < pool->num_threads; ++k) {
+		t = take_task(&(pool->deques[(i + k) % pool->num_threads]), 1);
+		if (t >= 0) {
+			pool->steals[i]++;
+			return t;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * runs job for every thread of the pool, with the calling thread as thread 0,
+ * and returns once all of them are done
+ */
+void
+raster_pool_run(struct raster_pool *pool, struct shape *s,
+		void (*job)(struct shape *, int))
+{
+	pthread_mutex_lock(&(pool->lock));
+	pool->job = job;
+	pool->s = s;
+	pool->running = pool->num_threads - 1;
+	pool->frame++;
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+
+	run_job(pool, 0);
+
+	pthread_mutex_lock(&(pool->lock));
+	while (pool->running > 0) {
+		pthread_cond_wait(&(pool->done), &(pool->lock));
+	}
+	pthread_mutex_unlock(&(pool->lock));
+}
+
+/*
+ * merges the cells of every thread into cells, taking each dot from the
+ * thread that filled it with the lowest key. The dots of a cell are numbered
+ * across then down, like the dots of the screen
+ *
+ * only the rows some thread drew into are looked at. A row only one thread
+ * drew into is just its cells, and the others are merged a dot at a time
+ * across the threads that drew into them. The rows are then emptied again
+ * for the next frame
+ */
+void
+raster_pool_merge(struct raster_pool *pool, uint16_t *cells,
+		  enum pixel_mode mode)
+{
+	int i, n, r, d, sx, dots, best, who[MAX_THREADS];
+	size_t k, first, end;
+	uint16_t any, dot, *own;
+	uint32_t key, *keys;
+
+	sx = fb_dots_x(mode);
+	dots = sx * fb_dots_y(mode);
+
+	for (r = 0; r < pool->rows; ++r) {
+		n = 0;
+		for (i = 0; i < pool->num_threads; ++i) {
+			if (pool->touched[i * pool->rows + r]) {
+				who[n++] = i;
+			}
+		}
+
+		if (n == 0) {
+			continue;
+		}
+
+		first = (size_t) r * pool->cols;
+		end = first + pool->cols;
+
+		if (n == 1) {
+			own = &(pool->cells[who[0] * pool->num_cells]);
+			for (k = first; k < end; ++k) {
+				cells[k] |= own[k];
+			}
+		}
+
+		for (k = first; k < end && n > 1; ++k) {
+			any = 0;
+			for (i = 0; i < n; ++i) {
+				any |= pool->cells[who[i] * pool->num_cells + k];
+			}
+
+			if (any == 0) {
+				continue;
+			}
+
+			for (d = 0; d < dots; ++d) {
+				best = -1;
+				key = RASTER_NO_KEY;
+
+				for (i = 0; i < n; ++i) {
+					keys = &(pool->keys[who[i] *
+							    pool->num_dots]);
+					if (keys[k * dots + d] < key) {
+						key = keys[k * dots + d];
+						best = who[i];
+					}
+				}
+
+				if (best >= 0) {
+					dot = fb_dot(mode, d % sx, d / sx);
+					cells[k] |= pool->cells[best *
+								pool->num_cells +
+								k] &
+						    (dot | dot << 8);
+				}
+			}
+		}
+
+		for (i = 0; i < n; ++i) {
+			memset(&(pool->cells[who[i] * pool->num_cells + first]),
+			       0, sizeof(uint16_t) * pool->cols);
+			memset(&(pool->keys[who[i] * pool->num_dots +
+					    first * dots]),
+			       0xff, sizeof(uint32_t) * pool->cols * dots);
+			pool->touched[who[i] * pool->rows + r] = 0;
+		}
+	}
+}
+
+/*
+ * stops the threads and frees the pool
+ */
+void
+raster_pool_destroy(struct raster_pool *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	stop_threads(pool, pool->num_threads - 1);
+}
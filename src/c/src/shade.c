@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include "shade.h"
+#include "framebuffer.h"
+#include "zbuffer.h"
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * picks the character from the ramp for every face, from the angle between
+ * the face and the light. Normals aren't kept in any consistent direction, so
+ * each one is flipped to face the viewer first
+ */
+static
+void
+shade_table(struct shape *s)
+{
+	int i, len;
+	double lum, mag;
+	point3 n, light, unit_light;
+	const char *ramp;
+
+	ramp = SHADE_RAMP;
+	len = strlen(ramp);
+
+	light = (point3) LIGHT;
+	vector3_unit(&light, &unit_light);
+
+	/* dots that no face covers are left blank */
+	s->zb->face_shade[0] = 0;
+
+	for (i = 0; i < s->num_f; ++i) {
+		n = s->normals[i];
+		if (n.z < 0) {
+			vector3_mult(&n, -1, &n);
+		}
+
+		mag = vector3_mag(&n);
+		lum = mag > 0 ? vector3_dot(&n, &unit_light) / mag : 0;
+		lum = lum < 0 ? 0 : lum;
+
+		s->zb->face_shade[i + 1] = ramp[(int) (lum * (len - 1) + 0.5)];
+	}
+}
+
+/*
+ * fills the shade layer of the framebuffer from the faces in the depth
+ * buffer, which has to have been rendered for this frame
+ *
+ * each cell takes the face at the dot nearest its center. The depth buffer
+ * already holds the closest face per dot, so this is a table lookup per cell
+ * with no branches
+ */
+void
+shade_faces(struct shape *s)
+{
+	int row, col, sx, sy;
+	int *id;
+	uint8_t *shade, *table;
+
+	shade_table(s);
+
+	sx = s->view.dots_x;
+	sy = s->view.dots_y;
+	table = s->zb->face_shade;
+
+	for (row = 0; row < s->fb->rows; ++row) {
+		id = &(s->zb->face[(row * sy + sy / 2) * s->zb->cols + sx / 2]);
+		shade = &(s->fb->shade[row * s->fb->cols]);
+
+		for (col = 0; col < s->fb->cols; ++col) {
+			shade[col] = table[id[col * sx]];
+		}
+	}
+}
@@ -18,10 +18,12 @@
 #define _POSIX_C_SOURCE 199309L
 
 #include <sys/types.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-#include <ncurses.h>
+#include <unistd.h>
 
 #if TIMING
 #include "timing.h"
@@ -30,35 +32,46 @@
 #include "term_shapes.h"
 #include "vector.h"
 #include "convex_occlusion.h"
+#include "zbuffer.h"
+#include "hidden_line.h"
+#include "raster_pool.h"
 #include "occlude_approx.h"
 #include "print.h"
+#include "present.h"
+#include "framebuffer.h"
+#include "backend.h"
 #include "transform.h"
 #include "init.h"
 
 
 /*
- * chooses which occlusion method to use based on the s.occlusion enum
+ * chooses which occlusion method to use based on the s.occlusion enum, once
+ * for a whole block of points on the same edge
  *
- * returns 0 if point should be rendered, else 1
+ * returns a mask with bit i set if point i should be occluded
  */
-int
-occlude_point(struct shape *s, point3 *point, struct edge *edge)
+uint64_t
+occlude_block(struct shape *s, struct point_block *b, struct edge *edge)
 {
 	switch (s->occlusion) {
 	case NONE:
-		return 1;
+		return b->n == OCC_BLOCK ? ~(uint64_t) 0 :
+		       ((uint64_t) 1 << b->n) - 1;
 
 	case APPROX:
-		return occlude_point_approx(s, point);
+		return occlude_block_approx(s, b);
 
 	case CONVEX:
-		return occlude_point_convex(s, point, edge);
+		return occlude_block_convex(s, b, edge);
 
 	case CONVEX_CLEAR:
-		return occlude_point_convex(s, point, edge);
+		return occlude_block_convex(s, b, edge);
 
-	case EXACT: /* not implemented */
-		return 0;
+	case EXACT:
+		return occlude_block_zbuffer(s, b);
+
+	case ANALYTIC:
+		return occlude_block_analytic(s, b);
 	}
 
 	return 0;
@@ -66,272 +79,572 @@ occlude_point(struct shape *s, point3 *point, struct edge *edge)
 
 
 /*
- * loop which re-prints the shape with every keypress, and checks for certain
- * keyboard input to determine functions to run on the shape
+ * state of the main loop, kept from frame to frame
+ */
+struct loop_state {
+	/*
+	 * when frames are due in the interactive loop, as absolute times on
+	 * the monotonic clock, so the time spent drawing a frame doesn't push
+	 * back every frame after it
+	 */
+	int64_t period; /* nanoseconds between frames */
+	int64_t next;   /* when the next frame is due */
+	long skipped;   /* frames dropped because drawing ran over */
+
+	int dirty;  /* something changed since the last frame was drawn */
+	int events; /* keys folded into the frame being drawn */
+
+#if TIMING
+	/* cpu time spent drawing frames, and on everything in between */
+	struct timespec start;
+	struct timespec print;
+	struct timespec op;
+	struct timespec avg_print;
+	struct timespec avg_op;
+#endif
+};
+
+/*
+ * time on the monotonic clock in nanoseconds
  */
 static
-void
-loop(struct shape *s)
+int64_t
+clock_ns(void)
 {
-	int c;
-	double theta, dist, scale;
+	struct timespec t;
 
-#if USE_NCURSES
-	char *occlusion_type = "";
-#endif
+	clock_gettime(CLOCK_MONOTONIC, &t);
 
-#if TIMING
-	struct timespec start, end, diff, avg_op, avg_print;
+	return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
 
-	avg_op.tv_sec = -1;
-	avg_op.tv_nsec = -1;
+/*
+ * prints how long each thread of the pool was busy drawing the last frame, in
+ * milliseconds of CPU time, and how many tasks were stolen, so it shows how
+ * evenly the edges were spread over the threads
+ */
+static
+void
+print_load(struct shape *s, int row)
+{
+	int i, n, steals;
+	char line[20 * MAX_THREADS];
+	struct raster_pool *pool;
+
+	pool = s->pool;
+	steals = 0;
+	n = 0;
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		n += snprintf(&line[n], sizeof(line) - n, " %.3f",
+			      pool->busy[i] / 1e6);
+		steals += pool->steals[i];
+	}
 
-	avg_print.tv_sec = -1;
-	avg_print.tv_nsec = -1;
-#endif
+	present_text(s, row, 1, "Thread busy time:%s ms, %d of %d tasks stolen",
+		line, steals, pool->num_tasks);
+}
 
-#if USE_NCURSES
-	/* start ncurses mode */
-	initscr();
-	noecho();
-	cbreak();
-	keypad(stdscr, TRUE);
-	curs_set(0);
-#endif
+/*
+ * prints the text about how the shape is drawn over the frame
+ *
+ * the text goes over the frame before it's presented, so only the parts of it
+ * that changed are written. The present stats are from the frame before
+ */
+static
+void
+print_status(struct shape *s, struct loop_state *ls)
+{
+	char *occlusion_type = "";
+	char *raster_type = "";
+	char *pixel_type = "";
 
-	theta = M_PI / 200;
-	dist = 0.1;
-	scale = 1.1;
+	switch (s->occlusion) {
+	case NONE:
+		occlusion_type = "none";
+		break;
+
+	case APPROX:
+		occlusion_type = "approximate";
+		break;
+
+	case CONVEX:
+		occlusion_type = "convex";
+		break;
+	case CONVEX_CLEAR:
+		occlusion_type = "convex_clear";
+		break;
+	case EXACT:
+		occlusion_type = "exact";
+		break;
+	case ANALYTIC:
+		occlusion_type = "analytic";
+		break;
+	}
+	present_text(s, 1, 1, "Occlusion type: %s", occlusion_type);
 
 #if TIMING
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	present_text(s, 2, 1, "Print time: %ld.%06ld seconds",
+		ls->print.tv_sec, ls->print.tv_nsec / 1000);
+	present_text(s, 3, 1, "Operation time: %ld.%06ld seconds",
+		ls->op.tv_sec, ls->op.tv_nsec / 1000);
 #endif
 
-	while (1) {
+	switch (s->raster) {
+	case SAMPLE:
+		raster_type = "sample";
+		break;
 
-#if USE_NCURSES
-		wclear(stdscr);
+	case DDA:
+		raster_type = "dda";
+		break;
+	}
 
-		switch (s->occlusion) {
-		case NONE:
-			occlusion_type = "none";
-			break;
+	switch (s->pixels) {
+	case HALF_BLOCK:
+		pixel_type = "half block";
+		break;
 
-		case APPROX:
-			occlusion_type = "approximate";
-			break;
+	case BRAILLE:
+		pixel_type = "braille";
+		break;
+	}
+	present_text(s, 4, 1, "Raster type: %s, %s%s", raster_type,
+		pixel_type, s->fill ? ", filled" : "");
 
-		case CONVEX:
-			occlusion_type = "convex";
-			break;
-		case CONVEX_CLEAR:
-			occlusion_type = "convex_clear";
-			break;
-		case EXACT:
-			occlusion_type = "exact not implemented";
-			break;
-		}
-		mvprintw(1, 1, "Occlusion type: %s", occlusion_type);
-#endif
+	present_text(s, 5, 1, "Present: %d cells, %d spans, %ld bytes%s",
+		s->fb->stats.cells, s->fb->stats.spans, s->fb->stats.bytes,
+		s->backend->estimated ? " (estimated)" : "");
 
+	if (s->backend->interactive) {
+		present_text(s, 6, 1,
+			"Frame rate: %d fps, %ld skipped, %d keys this frame",
+			FRAME_RATE, ls->skipped, ls->events);
+	}
 
-#if TIMING
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
-		timespec_diff(&start, &end, &diff);
+	if (s->threads > 1 && s->pool != NULL) {
+		print_load(s, s->backend->interactive ? 7 : 6);
+	}
+}
 
-# if USE_NCURSES
-		mvprintw(3, 1, "Operation time: %ld.%06ld seconds",
-			diff.tv_sec, diff.tv_nsec / 1000);
-# endif
+/*
+ * prints the shape and the text about how it's drawn, and presents them
+ */
+static
+void
+draw_frame(struct shape *s, struct loop_state *ls)
+{
+#if TIMING
+	struct timespec now;
 
-		timespec_avg(&avg_op, &diff, &avg_op);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	timespec_diff(&(ls->start), &now, &(ls->op));
+	timespec_avg(&(ls->avg_op), &(ls->op), &(ls->avg_op));
 
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(ls->start));
 #endif
 
-		print_shape(s);
+	print_shape(s);
+	ls->dirty = 0;
 
 #if TIMING
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	timespec_diff(&(ls->start), &now, &(ls->print));
+	timespec_avg(&(ls->avg_print), &(ls->print), &(ls->avg_print));
+#endif
 
-		timespec_diff(&start, &end, &diff);
+	if (!s->quiet) {
+		print_status(s, ls);
+	}
+	ls->events = 0;
 
-# if USE_NCURSES
-		mvprintw(2, 1, "Print time: %ld.%06ld seconds",
-			diff.tv_sec, diff.tv_nsec / 1000);
-# endif
+	present_frame(s);
+	s->fb->stats.bytes += s->backend->flush(s->backend);
 
-		timespec_avg(&avg_print, &diff, &avg_print);
+#if TIMING
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(ls->start));
 #endif
+}
 
+/*
+ * checks keyboard input for functions to run on the shape
+ *
+ * returns 1 if the shape has to be drawn again, 0 if the key did nothing, and
+ * -1 to quit
+ */
+static
+int
+handle_key(struct shape *s, int c)
+{
+	double theta, dist, scale;
+
+	theta = M_PI / 200;
+	dist = 0.1;
+	scale = 1.1;
+
+	switch (c) {
+	case 'q':
+		return -1;
+
+	/* ** ROTATIONS ** */
+	/* rotate around z axis */
+	case 't':
+		rotate_shape(theta, 'z', s);
+		break;
+	case 'y':
+		rotate_shape(-theta, 'z', s);
+		break;
+
+	/* rotate around x axis */
+	case 'u':
+		rotate_shape(theta, 'x', s);
+		break;
+	case 'i':
+		rotate_shape(-theta, 'x', s);
+		break;
+
+	/* rotate around y axis */
+	case 'o':
+		rotate_shape(-theta, 'y', s);
+		break;
+	case 'p':
+		rotate_shape(theta, 'y', s);
+		break;
+
+	/* ** SCALE ** */
+	case '=':
+		scale_shape(scale, s);
+		break;
+
+	case '-':
+		scale_shape(1.0 / scale, s);
+		break;
+
+
+	/* ** TRANSLATIONS ** */
+	/* translate along x axis */
+	case 'h':
+		translate_shape(-dist, 'x', s);
+		break;
+	case 'l':
+		translate_shape(dist, 'x', s);
+		break;
+
+
+	/* translate along y axis */
+	case 'j':
+		translate_shape(-dist, 'y', s);
+		break;
+
+	case 'k':
+		translate_shape(dist, 'y', s);
+		break;
+
+	/* translate along z axis */
+	case 'f':
+		translate_shape(-dist, 'z', s);
+		break;
+	case 'g':
+		translate_shape(dist, 'z', s);
+		break;
 
 #if USE_NCURSES
-		c = getch();
-#else
-		c = getchar();
-#endif
+	/* AUTOROTATE, on or off */
+	case 'a':
+		if (!s->backend->interactive) {
+			break;
+		}
 
-#if TIMING
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+		if (s->autorotate) {
+			s->autorotate = 0;
+		} else {
+			autorotate(s);
+		}
+		break;
 #endif
 
-		switch(c) {
-		case 'q':
+	/* RESET */
+	case 'r':
+		reset_shape(s);
+		break;
+
+	/* flip printing of vertices */
+	case '1':
+		s->print_vertices = !(s->print_vertices);
+		break;
+
+	/* flip printing of edges */
+	case '2':
+		s->print_edges = !(s->print_edges);
+		break;
+
+	/* turn occlusion on or off */
+	case '3':
+		s->occlusion++;
+		if (s->occlusion > ANALYTIC) {
+			s->occlusion = NONE;
+		}
 
-#if USE_NCURSES
-			/* end ncurses mode */
-			endwin();
-#endif
+		break;
+
+	/* switch between raster methods */
+	case '4':
+		s->raster = (s->raster == SAMPLE) ? DDA : SAMPLE;
+		break;
+
+	/* switch between half block and braille cells */
+	case '5':
+		s->pixels = (s->pixels == HALF_BLOCK) ? BRAILLE : HALF_BLOCK;
+
+		/* the same dots in the other mode are a different glyph */
+		fb_invalidate(s->fb);
+		break;
+
+	/* fill the faces with characters shaded by a light */
+	case '6':
+		s->fill = !(s->fill);
+		break;
+
+	/* the screen changed size, and anything on it may be gone */
+	case BACKEND_RESIZE:
+		fb_invalidate(s->fb);
+		break;
+
+	/* **CHANGE EDGE DENSITY** */
+	/* increase edge density */
+	case '0':
+		s->e_density++;
+		break;
+
+	/* decrease edge density */
+	case '9':
+		if (s->e_density > 0) {
+			s->e_density--;
+		}
+		break;
 
-#if TIMING
-			printf("Average operation time: %ld.%06ld seconds\n",
-				avg_op.tv_sec, avg_op.tv_nsec / 1000);
+	default:
+		return 0;
+	}
 
-			printf("Average print time: %ld.%06ld seconds\n",
-				avg_print.tv_sec, avg_print.tv_nsec / 1000);
-#endif
+	return 1;
+}
 
+/*
+ * loop for the headless backends, which draws a frame after every key. There's
+ * no clock, so a scripted session gives the same frames however fast it runs
+ */
+static
+void
+headless_loop(struct shape *s, struct loop_state *ls)
+{
+	while (handle_key(s, s->backend->read_key(s->backend)) >= 0) {
+		draw_frame(s, ls);
+	}
+}
+
+/*
+ * loop for interactive backends, where input, autorotation and drawing are
+ * separate events. Keys are handled as soon as they come in, and the shape
+ * is drawn at most once a frame, on a schedule of FRAME_RATE frames a second.
+ * Transforms only add to the motion of the shape, so a held key repeating
+ * many times a frame still costs one update of the model and one draw.
+ * When a frame takes longer than that to draw, the frames it ran into are
+ * dropped rather than drawn late, and autorotation turns the shape by the
+ * time that passed so it keeps its speed. The loop ends when the user quits,
+ * or when input hangs up or can't be waited on, since no more keys can come
+ */
+static
+void
+paced_loop(struct shape *s, struct loop_state *ls)
+{
+	int c, n, changed, timeout, rotating;
+	int64_t now, frames;
+	struct pollfd in;
+
+	in.fd = STDIN_FILENO;
+	in.events = POLLIN;
+
+	ls->period = 1000000000 / FRAME_RATE;
+	ls->next = clock_ns() + ls->period;
+
+	while (1) {
+		/* wait for input or for the next frame to be due */
+		if (!ls->dirty && !s->autorotate) {
+			timeout = -1;
+		} else {
+			now = clock_ns();
+			timeout = ls->next > now ?
+				  (int) ((ls->next - now + 999999) / 1000000) : 0;
+		}
+
+		n = poll(&in, 1, timeout);
+		if (n < 0 && errno != EINTR) {
 			return;
+		}
 
-		/* ** ROTATIONS ** */
-		/* rotate around z axis */
-		case 't':
-			rotate_shape(theta, 'z', s);
-			break;
-		case 'y':
-			rotate_shape(-theta, 'z', s);
-			break;
+		/* a signal like a resize can leave a key queued too */
+		if (n != 0) {
+			rotating = s->autorotate;
 
-		/* rotate around x axis */
-		case 'u':
-			rotate_shape(theta, 'x', s);
-			break;
-		case 'i':
-			rotate_shape(-theta, 'x', s);
-			break;
+			while ((c = s->backend->poll_key(s->backend)) !=
+			       BACKEND_NO_KEY) {
+				changed = handle_key(s, c);
+				if (changed < 0) {
+					return;
+				}
 
-		/* rotate around y axis */
-		case 'o':
-			rotate_shape(-theta, 'y', s);
-			break;
-		case 'p':
-			rotate_shape(theta, 'y', s);
-			break;
+				ls->dirty |= changed;
+				ls->events++;
+			}
 
-		/* ** SCALE ** */
-		case '=':
-			scale_shape(scale, s);
-			break;
+			/* the keys sent before a hang up are still handled */
+			if (n > 0 &&
+			    (in.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+				return;
+			}
 
-		case '-':
-			scale_shape(1.0 / scale, s);
-			break;
+			/*
+			 * after waiting with nothing to draw, or for the
+			 * autorotate prompt, no frames were missed
+			 */
+			if (timeout < 0 || s->autorotate != rotating) {
+				ls->next = clock_ns();
+			}
+		}
 
+		now = clock_ns();
+		if (now < ls->next) {
+			continue;
+		}
 
-		/* ** TRANSLATIONS ** */
-		/* translate along x axis */
-		case 'h':
-			translate_shape(-dist, 'x', s);
-			break;
-		case 'l':
-			translate_shape(dist, 'x', s);
-			break;
+		frames = 1 + (now - ls->next) / ls->period;
+		ls->skipped += frames - 1;
+		ls->next += frames * ls->period;
 
+		if (s->autorotate) {
+			autorotate_shape(s, frames * ls->period * 1e-9);
+			ls->dirty = 1;
+		}
 
-		/* translate along y axis */
-		case 'j':
-			translate_shape(-dist, 'y', s);
-			break;
+		if (ls->dirty) {
+			draw_frame(s, ls);
+		}
+	}
+}
 
-		case 'k':
-			translate_shape(dist, 'y', s);
-			break;
+/*
+ * draws the shape, then runs the loop for the backend until the user quits
+ */
+static
+void
+loop(struct shape *s)
+{
+	struct loop_state ls;
 
-		/* translate along z axis */
-		case 'f':
-			translate_shape(-dist, 'z', s);
-			break;
-		case 'g':
-			translate_shape(dist, 'z', s);
-			break;
+	ls.skipped = 0;
+	ls.dirty = 0;
+	ls.events = 0;
 
-#if USE_NCURSES
-		/* AUTOROTATE */
-		case 'a':
-			autorotate(s);
-			break;
+#if TIMING
+	ls.avg_op.tv_sec = -1;
+	ls.avg_op.tv_nsec = -1;
+
+	ls.avg_print.tv_sec = -1;
+	ls.avg_print.tv_nsec = -1;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(ls.start));
 #endif
 
-		/* RESET */
-		case 'r':
-			reset_shape(s);
-			break;
+	draw_frame(s, &ls);
 
-		/* flip printing of vertices */
-		case '1':
-			s->print_vertices = !(s->print_vertices);
-			break;
+	if (s->backend->poll_key != NULL) {
+		paced_loop(s, &ls);
+	} else {
+		headless_loop(s, &ls);
+	}
 
-		/* flip printing of edges */
-		case '2':
-			s->print_edges = !(s->print_edges);
-			break;
+	s->backend->end(s->backend);
 
-		/* turn occlusion on or off */
-		case '3':
-			s->occlusion++;
-			if (s->occlusion > EXACT) {
-				s->occlusion = NONE;
-			}
+#if TIMING
+	if (s->quiet) {
+		return;
+	}
 
-			/*
-			 * because the icosahedron and dodecahedron are put in
-			 * using an approximation of phi, do a quick set of
-			 * rotations to fix some apparent floating point
-			 * precision weirdness with occlusion
-			 */
+	printf("Average operation time: %ld.%06ld seconds\n",
+		ls.avg_op.tv_sec, ls.avg_op.tv_nsec / 1000);
 
-			if (s->occlusion == CONVEX) {
-				rotate_shape(theta, 'x', s);
-				rotate_shape(theta, 'y', s);
-				rotate_shape(theta, 'z', s);
+	printf("Average print time: %ld.%06ld seconds\n",
+		ls.avg_print.tv_sec, ls.avg_print.tv_nsec / 1000);
+#endif
+}
 
-				rotate_shape(-theta, 'x', s);
-				rotate_shape(-theta, 'y', s);
-				rotate_shape(-theta, 'z', s);
-			}
+static
+void
+usage(char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-b ncurses|memory|text] [-g COLSxROWS] [-j THREADS] "
+		"[-q] [file]\n",
+		name);
+}
 
+int
+main(int argc, char **argv)
+{
+	int err, opt, rows, cols, threads, quiet;
+	struct shape s;
+	struct backend *backend;
+
+	backend = backend_default();
+	rows = BACKEND_ROWS;
+	cols = BACKEND_COLS;
+	threads = 1;
+	quiet = 0;
+
+	while ((opt = getopt(argc, argv, "b:g:j:q")) != -1) {
+		switch (opt) {
+		/* backend to present frames with */
+		case 'b':
+			backend = backend_find(optarg);
+			if (backend == NULL) {
+				fprintf(stderr, "unknown backend: %s\n", optarg);
+				exit(1);
+			}
 			break;
 
-		/* **CHANGE EDGE DENSITY** */
-		/* increase edge density */
-		case '0':
-			s->e_density++;
-			resize_points_to_print(s);
+		/* screen size of the headless backends */
+		case 'g':
+			if (sscanf(optarg, "%dx%d", &cols, &rows) != 2 ||
+			    rows <= 0 || cols <= 0) {
+				fprintf(stderr, "invalid size: %s\n", optarg);
+				exit(1);
+			}
 			break;
 
-		/* decrease edge density */
-		case '9':
-			if (s->e_density > 0) {
-				s->e_density--;
-				resize_points_to_print(s);
+		/* threads to draw edges with */
+		case 'j':
+			if (sscanf(optarg, "%d", &threads) != 1 || threads < 1 ||
+			    threads > MAX_THREADS) {
+				fprintf(stderr, "invalid number of threads: %s\n",
+					optarg);
+				exit(1);
 			}
 			break;
 
+		/* frames only, for output that's the same from run to run */
+		case 'q':
+			quiet = 1;
+			break;
+
 		default:
-			continue;
+			usage(argv[0]);
+			exit(1);
 		}
 	}
-}
-
-int
-main(int argc, char **argv)
-{
-	int err;
-	struct shape s;
 
-	if (argc > 1) {
-		err = init_from_file(argv[1], &s);
+	if (optind < argc) {
+		err = init_from_file(argv[optind], &s);
 	} else {
 		err = init_cube(&s);
 	}
@@ -340,6 +653,16 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	backend_set_size(backend, rows, cols);
+	if (backend->init(backend) != 0) {
+		printf("error initializing %s backend\n", backend->name);
+		exit(1);
+	}
+
+	s.backend = backend;
+	s.threads = threads;
+	s.quiet = quiet;
+
 	loop(&s);
 
 	destroy_shape(&s);
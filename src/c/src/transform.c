@@ -1,37 +1,103 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <ncurses.h>
 
+/*
+ * the AVX2 kernel is built with a target attribute and picked when the
+ * program runs, so the same binary uses it where the CPU has it
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_AVX2 1
+#include <immintrin.h>
+#endif
+
 #include "vector.h"
 #include "transform.h"
 #include "init.h"
 #include "print.h"
+#include "present.h"
+#include "framebuffer.h"
+#include "backend.h"
 #include "term_shapes.h"
 
 /*
- * rotates each point in one of 6 directions, given the angle (can be positive
- * or negative) and the axis around which to rotate
+ * keeps the rows of the rotation of the model orthonormal, so the rounding of
+ * every turn doesn't add up to skewing or scaling the shape (Gram-Schmidt)
  */
+static
 void
-rotate_shape(double theta, char axis, struct shape *s)
+orthonormalize(double rot[3][3])
 {
 	int i;
-	double *fst, *snd;
-	double presin, precos, cfst, csnd, tempfst, tempsnd;
+	double dot, mag;
+
+	mag = sqrt(rot[0][0] * rot[0][0] + rot[0][1] * rot[0][1] +
+		   rot[0][2] * rot[0][2]);
+	for (i = 0; i < 3; ++i) {
+		rot[0][i] /= mag;
+	}
 
-	/* get center values and test whether axis in 'xyz' */
+	dot = rot[0][0] * rot[1][0] + rot[0][1] * rot[1][1] +
+	      rot[0][2] * rot[1][2];
+	for (i = 0; i < 3; ++i) {
+		rot[1][i] -= dot * rot[0][i];
+	}
+
+	mag = sqrt(rot[1][0] * rot[1][0] + rot[1][1] * rot[1][1] +
+		   rot[1][2] * rot[1][2]);
+	for (i = 0; i < 3; ++i) {
+		rot[1][i] /= mag;
+	}
+
+	/* the last row is whatever keeps the rotation right handed */
+	rot[2][0] = rot[0][1] * rot[1][2] - rot[0][2] * rot[1][1];
+	rot[2][1] = rot[0][2] * rot[1][0] - rot[0][0] * rot[1][2];
+	rot[2][2] = rot[0][0] * rot[1][1] - rot[0][1] * rot[1][0];
+}
+
+/*
+ * empties a motion, so applying it leaves the model as it is
+ */
+void
+motion_reset(struct motion *m)
+{
+	*m = (struct motion) {
+		0,
+		0,
+		{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+		1,
+		{0, 0, 0}
+	};
+}
+
+/*
+ * rotates the shape around its center in one of 6 directions, given the angle
+ * (can be positive or negative) and the axis around which to rotate
+ *
+ * the turn is composed into the motion of the shape, which turns each of its
+ * columns like a point. The model and the vertices follow in apply_model()
+ */
+void
+rotate_shape(double theta, char axis, struct shape *s)
+{
+	int i, fst, snd;
+	double presin, precos, tempfst, tempsnd;
+	double (*rot)[3];
+
+	/* which coordinates the rotation mixes */
 	switch (axis) {
 	case 'x':
-		cfst = s->center.y;
-		csnd = s->center.z;
+		fst = 1;
+		snd = 2;
 		break;
 	case 'y':
-		cfst = s->center.z;
-		csnd = s->center.x;
+		fst = 2;
+		snd = 0;
 		break;
 	case 'z':
-		cfst = s->center.x;
-		csnd = s->center.y;
+		fst = 0;
+		snd = 1;
 		break;
 	default:
 		return;
@@ -41,130 +107,310 @@ rotate_shape(double theta, char axis, struct shape *s)
 	presin = sin(theta);
 	precos = cos(theta);
 
-	/* change every point */
-	for (i = 0; i < s->num_v; ++i) {
-		switch (axis) {
-		case 'x':
-			fst = &(s->vertices[i].y);
-			snd = &(s->vertices[i].z);
-			break;
-		case 'y':
-			fst = &(s->vertices[i].z);
-			snd = &(s->vertices[i].x);
-			break;
-		case 'z':
-			fst = &(s->vertices[i].x);
-			snd = &(s->vertices[i].y);
-			break;
-		default: /* shouldn't get here */
-			exit(1);
-		}
+	rot = s->motion.rot;
+	for (i = 0; i < 3; ++i) {
+		tempfst = rot[fst][i];
+		tempsnd = rot[snd][i];
 
-		tempfst = *fst - cfst;
-		tempsnd = *snd - csnd;
-
-		*fst = tempfst * precos - tempsnd * presin;
-		*snd = tempsnd * precos + tempfst * presin;
-
-		*fst += cfst;
-		*snd += csnd;
+		rot[fst][i] = tempfst * precos - tempsnd * presin;
+		rot[snd][i] = tempsnd * precos + tempfst * presin;
 	}
 
-	/* calculate the normal for each face */
-	for (i = 0; i < s->num_f; ++i) {
-		vector3_normal(&(s->vertices[s->faces[i].face[0]]),
-			       &(s->vertices[s->faces[i].face[1]]),
-			       &(s->vertices[s->faces[i].face[2]]),
-			       &(s->faces[i].normal));
+	s->motion.turned = 1;
+
+	/*
+	 * the screen is a projection along z, so turning around z only turns
+	 * the picture, while turning around x or y changes what's in front
+	 */
+	if (axis != 'z') {
+		s->motion.turned_xy = 1;
 	}
 
+	s->moved = 1;
 }
 
 /*
- * scale the object by a given magnitude
+ * scale the object around its center by a given magnitude
  */
 void
 scale_shape(double mag, struct shape *s)
 {
-	int i;
-
-	for (i = 0; i < s->num_v; ++i) {
-		vector3_sub(&(s->vertices[i]), &(s->center), &(s->vertices[i]));
-		vector3_mult(&(s->vertices[i]), mag, &(s->vertices[i]));
-		vector3_add(&(s->vertices[i]), &(s->center), &(s->vertices[i]));
-	}
+	s->motion.scale *= mag;
+	s->moved = 1;
 }
 
 /*
- * translates each vertex given a distance and the axis which to translate
- * along
+ * translates the shape given a distance and the axis which to translate
+ * along, by moving its center
  */
 void
 translate_shape(double dist, char axis, struct shape *s)
 {
-	int i;
-
 	switch (axis) {
 	case 'x':
-		s->center.x += dist;
+		s->motion.move.x += dist;
 		break;
 	case 'y':
-		s->center.y += dist;
+		s->motion.move.y += dist;
 		break;
 	case 'z':
-		s->center.z += dist;
+		s->motion.move.z += dist;
 		break;
 	default:
 		return;
 	}
 
-	for (i = 0; i < s->num_v; ++i) {
-		switch (axis) {
-		case 'x':
-			s->vertices[i].x += dist;
-			printw("%f\n", s->vertices[i].y);
-			break;
-		case 'y':
-			s->vertices[i].y += dist;
-			break;
-		case 'z':
-			s->vertices[i].z += dist;
-			break;
-		default: /* shouldn't get here */
-			return;
+	s->moved = 1;
+}
+
+/*
+ * folds the transforms since the last frame into the model, as one product
+ * of rotations and one orthonormalize however many turns there were
+ */
+static
+void
+apply_motion(struct shape *s)
+{
+	int i, k;
+	double rot[3][3];
+	struct motion *m;
+
+	m = &(s->motion);
+
+	if (m->turned) {
+		for (i = 0; i < 3; ++i) {
+			for (k = 0; k < 3; ++k) {
+				rot[i][k] = m->rot[i][0] * s->model.rot[0][k] +
+					    m->rot[i][1] * s->model.rot[1][k] +
+					    m->rot[i][2] * s->model.rot[2][k];
+			}
 		}
+
+		memcpy(s->model.rot, rot, sizeof(rot));
+		orthonormalize(s->model.rot);
 	}
+
+	if (m->turned_xy) {
+		s->turns++;
+	}
+
+	s->model.scale *= m->scale;
+	vector3_add(&(s->center), &(m->move), &(s->center));
+
+	motion_reset(m);
+}
+
+#ifdef TRANSFORM_AVX2
+/*
+ * stores 4 points given as vectors of their x, y, and z as 12 doubles one
+ * after another, the way an array of points is laid out, by shuffling them
+ * into 3 full vectors rather than writing each coordinate on its own
+ */
+__attribute__((target("avx2")))
+static inline
+void
+store_points(double *p, __m256d x, __m256d y, __m256d z)
+{
+	/* x0 y0 z0 x1 */
+	_mm256_storeu_pd(p, _mm256_blend_pd(_mm256_blend_pd(
+		_mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)),
+		_mm256_permute4x64_pd(y, _MM_SHUFFLE(0, 0, 0, 0)), 0x2),
+		_mm256_permute4x64_pd(z, _MM_SHUFFLE(0, 0, 0, 0)), 0x4));
+
+	/* y1 z1 x2 y2 */
+	_mm256_storeu_pd(p + 4, _mm256_blend_pd(_mm256_blend_pd(
+		_mm256_permute4x64_pd(y, _MM_SHUFFLE(2, 2, 1, 1)), z, 0x2),
+		x, 0x4));
+
+	/* z2 x3 y3 z3 */
+	_mm256_storeu_pd(p + 8, _mm256_blend_pd(_mm256_blend_pd(
+		_mm256_permute4x64_pd(z, _MM_SHUFFLE(3, 3, 2, 2)),
+		_mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3)), 0x2),
+		_mm256_permute4x64_pd(y, _MM_SHUFFLE(3, 3, 3, 3)), 0x4));
 }
 
-/* resize the points_to_print array. */
-/* defaults to resetting the whole shape if malloc fails */
+/*
+ * transform_coords() four points per instruction with AVX2, for as many
+ * whole groups of four as there are
+ *
+ * returns the number of points done
+ */
+__attribute__((target("avx2")))
+static
 int
-resize_points_to_print(struct shape *s)
+transform_avx2(const struct coords *in, int n, double m[3][3], point3 *t,
+	       point3 *out, point3 *screen, struct viewport *v)
 {
-	free(s->fronts);
-	s->fronts = malloc(sizeof(struct point_to_print) * (s->num_e + 1) * (s->e_density + 1));
-	if (s->fronts == NULL) {
-		reset_shape(s);
-		return 1;
+	int i;
+	__m256d vx, vy, vz, wx, wy, wz;
+	__m256d m00, m01, m02, m10, m11, m12, m20, m21, m22, tx, ty, tz;
+	__m256d scale_x, scale_y, off_x, off_y;
+
+	m00 = _mm256_set1_pd(m[0][0]);
+	m01 = _mm256_set1_pd(m[0][1]);
+	m02 = _mm256_set1_pd(m[0][2]);
+	m10 = _mm256_set1_pd(m[1][0]);
+	m11 = _mm256_set1_pd(m[1][1]);
+	m12 = _mm256_set1_pd(m[1][2]);
+	m20 = _mm256_set1_pd(m[2][0]);
+	m21 = _mm256_set1_pd(m[2][1]);
+	m22 = _mm256_set1_pd(m[2][2]);
+	tx = _mm256_set1_pd(t->x);
+	ty = _mm256_set1_pd(t->y);
+	tz = _mm256_set1_pd(t->z);
+
+	scale_x = _mm256_setzero_pd();
+	scale_y = _mm256_setzero_pd();
+	off_x = _mm256_setzero_pd();
+	off_y = _mm256_setzero_pd();
+	if (screen != NULL) {
+		scale_x = _mm256_set1_pd(v->scale_x);
+		scale_y = _mm256_set1_pd(v->scale_y);
+		off_x = _mm256_set1_pd(v->off_x);
+		off_y = _mm256_set1_pd(v->off_y);
+	}
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		vx = _mm256_loadu_pd(&(in->x[i]));
+		vy = _mm256_loadu_pd(&(in->y[i]));
+		vz = _mm256_loadu_pd(&(in->z[i]));
+
+		wx = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(m00, vx), _mm256_mul_pd(m01, vy)),
+			_mm256_mul_pd(m02, vz)), tx);
+		wy = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(m10, vx), _mm256_mul_pd(m11, vy)),
+			_mm256_mul_pd(m12, vz)), ty);
+		wz = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(m20, vx), _mm256_mul_pd(m21, vy)),
+			_mm256_mul_pd(m22, vz)), tz);
+
+		store_points(&(out[i].x), wx, wy, wz);
+
+		if (screen != NULL) {
+			store_points(&(screen[i].x),
+				     _mm256_add_pd(_mm256_mul_pd(wx, scale_x),
+						   off_x),
+				     _mm256_add_pd(_mm256_mul_pd(wy, scale_y),
+						   off_y),
+				     wz);
+		}
+	}
+
+	return i;
+}
+#endif
+
+/*
+ * out = m * in + t for n points stored as a structure of arrays, written as an
+ * array of points. If screen isn't NULL the points are also projected on to
+ * it with the viewport v
+ *
+ * the rotation and scale of the model are one matrix and the move is t, so
+ * turning, scaling, moving, and projecting a point are one pass over the
+ * points rather than one pass each. Face normals go through the same kernel
+ * with only the rotation
+ *
+ * the points are written as arrays of points rather than of coordinates
+ * because everything after this reads them a point at a time by index, the
+ * two ends of an edge or the corners of a face, and a point is then one read
+ * from one place rather than three from three arrays
+ *
+ * where the CPU has AVX2 four points are done per instruction, and the rest
+ * go through the same arithmetic one at a time. Both give the same result
+ * as long as the compiler doesn't contract a multiply and an add into one
+ * FMA, which release_c turns off
+ */
+static
+void
+transform_coords(const struct coords *in, int n, double m[3][3], point3 *t,
+		 point3 *out, point3 *screen, struct viewport *v)
+{
+	int i;
+	double x, y, z;
+	point3 *w;
+
+	i = 0;
+
+#ifdef TRANSFORM_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		i = transform_avx2(in, n, m, t, out, screen, v);
 	}
+#endif
+
+	for (; i < n; ++i) {
+		x = in->x[i];
+		y = in->y[i];
+		z = in->z[i];
+		w = &(out[i]);
+
+		w->x = m[0][0] * x + m[0][1] * y + m[0][2] * z + t->x;
+		w->y = m[1][0] * x + m[1][1] * y + m[1][2] * z + t->y;
+		w->z = m[2][0] * x + m[2][1] * y + m[2][2] * z + t->z;
+
+		if (screen != NULL) {
+			viewport_project(v, w, &(screen[i]));
+		}
+	}
+}
 
-	free(s->behinds);
-	s->behinds = malloc(sizeof(struct point_to_print) * (s->num_e + 1) * (s->e_density + 1));
-	if (s->behinds == NULL) {
-		reset_shape(s);
-		return 1;
+/*
+ * moves the vertices to where the model places them and projects them on to
+ * the screen for the frame, in one pass over the vertices. The face normals
+ * are turned by the rotation of the model, since scaling and moving don't
+ * change which way a face faces
+ */
+void
+apply_model(struct shape *s)
+{
+	int i, k;
+	double m[3][3];
+	point3 still;
+
+	apply_motion(s);
+
+	for (i = 0; i < 3; ++i) {
+		for (k = 0; k < 3; ++k) {
+			m[i][k] = s->model.scale * s->model.rot[i][k];
+		}
 	}
 
-	return 0;
+	transform_coords(&(s->object), s->num_v, m, &(s->center), s->vertices,
+			 s->screen, &(s->view));
+
+	still = (point3) {0, 0, 0};
+	transform_coords(&(s->object_normals), s->num_f, s->model.rot, &still,
+			 s->normals, NULL, NULL);
+}
+
+/*
+ * turns an autorotating shape by as much as it turns in the given number of
+ * seconds, which is dir every interval. Going by the time that passed rather
+ * than by frames keeps the speed the same when frames are dropped
+ */
+void
+autorotate_shape(struct shape *s, double seconds)
+{
+	double k;
+
+	k = seconds / (s->interval.tv_sec + s->interval.tv_nsec * 1e-9);
+
+	rotate_shape(s->dir.x * k, 'x', s);
+	rotate_shape(s->dir.y * k, 'y', s);
+	rotate_shape(s->dir.z * k, 'z', s);
 }
 
 #if USE_NCURSES
+/*
+ * asks which way to turn the shape and starts autorotating it. The loop turns
+ * it with autorotate_shape() every frame until autorotate is turned off
+ */
 void
 autorotate(struct shape *s)
 {
 	char c;
 
-	mvprintw(1, 1, "Please enter 'a' for automatic rotate or 'm' for manual angle.");
+	present_printf(s, 1, 1, "Please enter 'a' for automatic rotate or 'm' for manual angle.");
 	c = getch();
 
 	if (c == 'm') {
@@ -181,6 +427,9 @@ autorotate(struct shape *s)
 
 		noecho();
 		curs_set(0);
+
+		/* the prompts cleared the screen */
+		fb_invalidate(s->fb);
 	} else {
 		s->dir.x = M_PI / 80;
 		s->dir.y = M_PI / 120;
@@ -188,28 +437,6 @@ autorotate(struct shape *s)
 
 	}
 
-	s->interval.tv_sec = 0;
-	s->interval.tv_nsec = 60000000;
-
-	nodelay(stdscr, TRUE);
-
-	while (1) {
-		wclear(stdscr);
-		print_shape(s);
-		mvprintw(1, 1, "%f %f %f", s->dir.x, s->dir.y, s->dir.z);
-
-		c = getch();
-		if (c == 'a') {
-			break;
-		}
-
-		rotate_shape(s->dir.x, 'x', s);
-		rotate_shape(s->dir.y, 'y', s);
-		rotate_shape(s->dir.z, 'z', s);
-
-		nanosleep(&s->interval, NULL);
-	}
-
-	nodelay(stdscr, FALSE);
+	s->autorotate = 1;
 }
 #endif
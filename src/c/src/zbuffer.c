@@ -0,0 +1,309 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zbuffer.h"
+#include "print.h"
+#include "vector.h"
+#include "term_shapes.h"
+
+/*
+ * allocate an empty depth buffer, which is sized on the first call to
+ * zb_render()
+ *
+ * returns NULL if the allocation failed
+ */
+struct zbuffer *
+zb_create(void)
+{
+	struct zbuffer *zb;
+
+	zb = malloc(sizeof(struct zbuffer));
+	if (zb == NULL) {
+		return NULL;
+	}
+
+	zb->rows = 0;
+	zb->cols = 0;
+	zb->depth = NULL;
+	zb->face = NULL;
+	zb->face_shade = NULL;
+	zb->max_faces = 0;
+	zb->cross = NULL;
+	zb->max_cross = 0;
+
+	return zb;
+}
+
+/*
+ * make the depth buffer hold rows * cols dots, only reallocating when the
+ * dimensions change
+ *
+ * returns 0 on success, -1 if the allocation failed
+ */
+static
+int
+zb_resize(struct zbuffer *zb, int rows, int cols)
+{
+	float *depth;
+	int *face;
+
+	if (zb->depth != NULL && zb->rows == rows && zb->cols == cols) {
+		return 0;
+	}
+
+	depth = realloc(zb->depth, ((size_t) rows * cols + 1) * sizeof(float));
+	if (depth == NULL) {
+		zb->rows = 0;
+		zb->cols = 0;
+		return -1;
+	}
+
+	zb->depth = depth;
+
+	face = realloc(zb->face, ((size_t) rows * cols + 1) * sizeof(int));
+	if (face == NULL) {
+		zb->rows = 0;
+		zb->cols = 0;
+		return -1;
+	}
+
+	zb->face = face;
+	zb->rows = rows;
+	zb->cols = cols;
+
+	return 0;
+}
+
+/*
+ * writes the depth and index of a face into every dot whose center is inside
+ * of it, keeping whichever face is closer
+ *
+ * the face is filled a row of dots at a time between pairs of crossings of
+ * the row with the edges of the face (the even-odd rule), which also handles
+ * faces that aren't convex or that cross themselves, like pentagrams. The
+ * depth is an affine function of the dot position, so along a row it's a
+ * multiply and add per dot, and the closer face is picked with a select and a
+ * mask rather than branches so the compiler can vectorize the row (depth is a
+ * float so it fits the same number of lanes as the face index)
+ */
+static
+void
+zb_face(struct shape *s, int f)
+{
+	int i, k, n, y, x, xstart, xend, ystart, yend, closer;
+	int *id;
+	double yc, bias, tmp;
+	float dzdx, dzdy, z, zrow;
+	float *depth;
+	struct face *face;
+	point3 *p0, *p1, *p2, *a, *b, e0, e1, m;
+	struct zbuffer *zb;
+
+	zb = s->zb;
+	face = &(s->faces[f]);
+
+	if (face->num_v < 3) {
+		return;
+	}
+
+	/*
+	 * the depth gradient over the screen, from the plane through the
+	 * first three vertices in dot coordinates (x, y, z)
+	 */
+	p0 = &(s->screen[face->face[0]]);
+	p1 = &(s->screen[face->face[1]]);
+	p2 = &(s->screen[face->face[2]]);
+
+	vector3_sub(p1, p0, &e0);
+	vector3_sub(p2, p0, &e1);
+	vector3_cross(&e0, &e1, &m);
+
+	/* the face is seen edge on and doesn't cover any dots */
+	if (fabs(m.z) < 1e-9) {
+		return;
+	}
+
+	dzdx = -m.x / m.z;
+	dzdy = -m.y / m.z;
+
+	/*
+	 * an edge point is tested against the dot it falls in, whose center
+	 * can be up to half a dot away on either axis, so the face is pushed
+	 * back by how much its depth changes over a dot
+	 */
+	bias = ZB_EPSILON + fabs(dzdx) + fabs(dzdy);
+
+	/* rows of dots whose centers the face covers */
+	ystart = zb->rows;
+	yend = -1;
+	for (i = 0; i < face->num_v; ++i) {
+		a = &(s->screen[face->face[i]]);
+
+		y = (int) ceil(a->y - 0.5);
+		ystart = y < ystart ? y : ystart;
+		y = (int) floor(a->y - 0.5);
+		yend = y > yend ? y : yend;
+	}
+
+	ystart = ystart < 0 ? 0 : ystart;
+	yend = yend >= zb->rows ? zb->rows - 1 : yend;
+
+	for (y = ystart; y <= yend; ++y) {
+		yc = y + 0.5;
+
+		/* where the center of this row crosses the edges of the face */
+		n = 0;
+		a = &(s->screen[face->face[face->num_v - 1]]);
+		for (i = 0; i < face->num_v; ++i) {
+			b = &(s->screen[face->face[i]]);
+
+			if ((a->y <= yc) != (b->y <= yc)) {
+				zb->cross[n++] = a->x + (yc - a->y) *
+						 (b->x - a->x) / (b->y - a->y);
+			}
+
+			a = b;
+		}
+
+		/* insertion sort, faces only have a few crossings */
+		for (i = 1; i < n; ++i) {
+			tmp = zb->cross[i];
+			for (k = i; k > 0 && zb->cross[k - 1] > tmp; --k) {
+				zb->cross[k] = zb->cross[k - 1];
+			}
+			zb->cross[k] = tmp;
+		}
+
+		/* depth at the center of the first dot of the row */
+		zrow = p0->z + (0.5 - p0->x) * dzdx + (yc - p0->y) * dzdy - bias;
+		depth = &(zb->depth[y * zb->cols]);
+		id = &(zb->face[y * zb->cols]);
+
+		for (i = 0; i + 1 < n; i += 2) {
+			xstart = (int) ceil(zb->cross[i] - 0.5);
+			xend = (int) ceil(zb->cross[i + 1] - 0.5) - 1;
+
+			xstart = xstart < 0 ? 0 : xstart;
+			xend = xend >= zb->cols ? zb->cols - 1 : xend;
+
+			for (x = xstart; x <= xend; ++x) {
+				z = zrow + x * dzdx;
+				closer = -(z > depth[x]);
+
+				depth[x] = z > depth[x] ? z : depth[x];
+				id[x] ^= (id[x] ^ (f + 1)) & closer;
+			}
+		}
+	}
+}
+
+/*
+ * rasterizes the depth of every face into the depth buffer, sized to the
+ * viewport of the frame, from the vertices projected for the frame
+ *
+ * returns 0 on success, -1 if an allocation failed
+ */
+int
+zb_render(struct shape *s)
+{
+	int i, max_v;
+	double *cross;
+	uint8_t *face_shade;
+	struct zbuffer *zb;
+
+	zb = s->zb;
+
+	if (zb_resize(zb, s->view.rows * s->view.dots_y,
+		      s->view.cols * s->view.dots_x) != 0) {
+		return -1;
+	}
+
+	/* a scanline crosses a face at most once per edge of the face */
+	max_v = 0;
+	for (i = 0; i < s->num_f; ++i) {
+		max_v = s->faces[i].num_v > max_v ? s->faces[i].num_v : max_v;
+	}
+
+	if (max_v > zb->max_cross) {
+		cross = realloc(zb->cross, sizeof(double) * max_v);
+		if (cross == NULL) {
+			return -1;
+		}
+
+		zb->cross = cross;
+		zb->max_cross = max_v;
+	}
+
+	if (s->num_f + 1 > zb->max_faces) {
+		face_shade = realloc(zb->face_shade, s->num_f + 1);
+		if (face_shade == NULL) {
+			return -1;
+		}
+
+		zb->face_shade = face_shade;
+		zb->max_faces = s->num_f + 1;
+	}
+
+	for (i = 0; i < zb->rows * zb->cols; ++i) {
+		zb->depth[i] = -HUGE_VALF;
+	}
+
+	memset(zb->face, 0, (size_t) zb->rows * zb->cols * sizeof(int));
+
+	for (i = 0; i < s->num_f; ++i) {
+		zb_face(s, i);
+	}
+
+	return 0;
+}
+
+/*
+ * occlusion method that works for any shape with faces, by testing the depth
+ * of each point against the depth buffer rendered for the frame
+ *
+ * returns a mask with bit i set if point i should be occluded
+ */
+uint64_t
+occlude_block_zbuffer(struct shape *s, struct point_block *b)
+{
+	int i;
+	long x, y;
+	uint64_t mask;
+	struct zbuffer *zb;
+	struct viewport *v;
+
+	zb = s->zb;
+	v = &(s->view);
+
+	mask = 0;
+	for (i = 0; i < b->n; ++i) {
+		x = (long) floor(b->x[i] * v->scale_x + v->off_x);
+		y = (long) floor(b->y[i] * v->scale_y + v->off_y);
+
+		if (x < 0 || x >= zb->cols || y < 0 || y >= zb->rows) {
+			continue;
+		}
+
+		mask |= (uint64_t) (b->z[i] < zb->depth[y * zb->cols + x]) << i;
+	}
+
+	return mask;
+}
+
+/*
+ * free memory allocated for the depth buffer
+ */
+void
+zb_destroy(struct zbuffer *zb)
+{
+	if (zb == NULL) {
+		return;
+	}
+
+	free(zb->depth);
+	free(zb->face);
+	free(zb->face_shade);
+	free(zb->cross);
+	free(zb);
+}
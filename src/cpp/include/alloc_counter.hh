@@ -0,0 +1,15 @@
+#ifndef ALLOC_COUNTER_HH
+#define ALLOC_COUNTER_HH
+
+#include <cstddef>
+
+namespace TS {
+/*
+ * total number of bytes requested through the global operator new since the
+ * program started. Comparing the value before and after a frame gives the
+ * bytes that frame allocated
+ */
+std::size_t allocated_bytes();
+}
+
+#endif /* ALLOC_COUNTER_HH */
@@ -0,0 +1,125 @@
+#ifndef BACKEND_HH
+#define BACKEND_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace TS {
+/*
+ * where presented frames go and where input comes from. The ncurses backend
+ * draws to the terminal, while the headless backends draw into an in-memory
+ * screen and read input from stdin, so the whole pipeline can run without a
+ * TTY
+ */
+class Backend {
+public:
+	static constexpr int DEFAULT_ROWS = 24;
+	static constexpr int DEFAULT_COLS = 80;
+
+	/* returned by read_key when the screen changed size */
+	static constexpr int RESIZE = -2;
+
+	virtual ~Backend() = default;
+
+	/* size of the screen in cells */
+	virtual void size(int &rows, int &cols) = 0;
+
+	/*
+	 * writes len characters of str starting at row, col, and returns the
+	 * number of bytes of output that took, if it's known before the flush
+	 */
+	virtual long put(int row, int col, const char *str, int len) = 0;
+
+	/*
+	 * makes everything put since the last flush visible, and returns the
+	 * number of bytes of output that took on top of what put returned
+	 */
+	virtual long flush() = 0;
+
+	/*
+	 * whether the bytes put and flush return are guessed from what was
+	 * asked for, rather than counted as they were written
+	 */
+	virtual bool estimated() const { return false; }
+
+	/*
+	 * blocks for the next key of input, returns 'q' at the end of input.
+	 * It's called from the input thread while the render thread draws
+	 */
+	virtual int read_key() = 0;
+
+	/*
+	 * whether the backend is a terminal someone is typing into, so every
+	 * key that came in during a frame can go into the next one. The
+	 * headless backends draw a frame for every key so their output doesn't
+	 * depend on timing
+	 */
+	virtual bool interactive() const { return false; }
+
+	/* backend by name, nullptr if there's no backend with that name */
+	static std::unique_ptr<Backend> create(const std::string &name,
+					       int rows = DEFAULT_ROWS,
+					       int cols = DEFAULT_COLS);
+};
+
+class NcursesBackend : public Backend {
+public:
+	NcursesBackend();
+	~NcursesBackend() override;
+
+	void size(int &rows, int &cols) override;
+	long put(int row, int col, const char *str, int len) override;
+	long flush() override;
+	int read_key() override;
+	bool interactive() const override { return true; }
+	bool estimated() const override { return this->io_fd < 0; }
+
+private:
+	/*
+	 * the kernel's count of the bytes the render thread has written, -1 if
+	 * the system doesn't keep it (see backend.cc)
+	 */
+	int io_fd = -1;
+
+	long written() const;
+
+	/*
+	 * written to by the SIGWINCH handler, which can run on any thread, and
+	 * waited on by read_key next to the terminal
+	 */
+	int resize_pipe[2] = {-1, -1};
+
+	/* returned by read_byte besides bytes and RESIZE */
+	static constexpr int NO_BYTE = -1; /* nothing came in time */
+	static constexpr int END = -3;     /* the terminal can't be read */
+
+	int read_byte(int timeout);
+};
+
+class MemoryBackend : public Backend {
+public:
+	MemoryBackend(int rows, int cols);
+
+	void size(int &rows, int &cols) override;
+	long put(int row, int col, const char *str, int len) override;
+	long flush() override;
+	int read_key() override;
+
+protected:
+	int rows;
+	int cols;
+	int frame = 0;
+	std::vector<char> grid;
+};
+
+/* in-memory screen that is dumped to stdout as text on every flush */
+class TextBackend : public MemoryBackend {
+public:
+	using MemoryBackend::MemoryBackend;
+
+	long flush() override;
+};
+}
+
+#endif /* BACKEND_HH */
@@ -0,0 +1,33 @@
+#ifndef COMMAND_HH
+#define COMMAND_HH
+
+namespace TS {
+/*
+ * what a key asks the shape to do. Commands are plain values, so the input
+ * thread can hand them to the render thread through a queue
+ */
+struct Command {
+	enum Type {
+		NONE, /* a key that changes nothing, the frame is drawn again */
+		QUIT,
+		RESIZE, /* the screen changed size, every cell is drawn again */
+		ROTATE,    /* amount radians around axis */
+		RESCALE,   /* by amount */
+		TRANSLATE, /* amount along axis */
+		TOGGLE_VERTICES,
+		TOGGLE_EDGES,
+		TOGGLE_RASTER,
+		INCREASE_E_DENSITY,
+		DECREASE_E_DENSITY
+	};
+
+	Type type = NONE;
+	int axis = 0; /* 0, 1, 2 for x, y, z */
+	double amount = 0;
+
+	/* command for a key of input */
+	static Command from_key(int c);
+};
+}
+
+#endif /* COMMAND_HH */
@@ -0,0 +1,92 @@
+#ifndef FRAMEBUFFER_HH
+#define FRAMEBUFFER_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "backend.hh"
+
+/*
+ * considering a "terminal pixel" as approximately 2x as high as it is wide,
+ * this enum is to determine whether the upper, lower, or both sections of the
+ * "terminal pixel" should be printed
+ */
+enum t_pixel_print {
+	UPPER = '\'',
+	LOWER = ',',
+	FULL = ';'
+};
+
+namespace TS {
+/*
+ * grid of cells indexed by integer (row, col), one per terminal position.
+ * Each cell holds which halves of the terminal pixel have been drawn, so
+ * merging an UPPER and a LOWER point into FULL is a bitwise or.
+ *
+ * The cell storage is kept between frames and only grows when the screen
+ * does, so a frame at a steady screen size doesn't allocate.
+ *
+ * The cells presented for the previous frame are kept as well, so presenting
+ * a frame only writes the cells that changed instead of clearing and
+ * redrawing the whole screen.
+ */
+class Framebuffer {
+public:
+	enum cell_bits : uint8_t {
+		CELL_UPPER = 1 << 0,
+		CELL_LOWER = 1 << 1,
+
+		/* screen contents not known, so the cell is always redrawn */
+		CELL_UNKNOWN = 0xff
+	};
+
+	/* what the last present wrote to the screen */
+	struct stats {
+		int cells = 0;  /* number of cells that changed */
+		int spans = 0;  /* number of runs of cells written */
+		long bytes = 0; /* bytes of output written to the screen */
+	};
+
+	/*
+	 * runs of unchanged cells shorter than this between two changed cells
+	 * are rewritten rather than moving the cursor over them
+	 */
+	static constexpr int PRESENT_GAP = 4;
+
+	void resize(int rows, int cols);
+	void clear();
+	void invalidate();
+
+	/* write the cells that changed since the last present to backend */
+	void present(Backend &backend);
+
+	/* print text over the presented frame, restored by the next present */
+	void text(Backend &backend, int row, int col, const char *str);
+
+	const struct stats &last_present() const { return this->present_stats; }
+
+	int rows() const { return this->n_rows; }
+	int cols() const { return this->n_cols; }
+
+	uint8_t &at(int row, int col) { return this->cells[row * this->n_cols + col]; }
+
+	/* bits a point occupies in a cell given its half of the terminal pixel */
+	static uint8_t bits(t_pixel_print t) { return t == UPPER ? CELL_UPPER : CELL_LOWER; }
+
+	/* character to print for the bits of a cell */
+	static t_pixel_print glyph(uint8_t bits);
+
+private:
+	int n_rows = 0;
+	int n_cols = 0;
+	std::vector<uint8_t> cells;
+	std::vector<uint8_t> prev;
+	std::vector<char> line; /* one row of characters being presented */
+
+	struct stats present_stats;
+
+	void present_span(Backend &backend, int row, int col, int end);
+};
+}
+
+#endif /* FRAMEBUFFER_HH */
@@ -0,0 +1,49 @@
+#ifndef INPUT_HH
+#define INPUT_HH
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "backend.hh"
+#include "command.hh"
+#include "spsc_queue.hh"
+
+namespace TS {
+/*
+ * reads keys from the backend on a thread of its own and turns them into
+ * commands for the render thread, so keys keep being read while a frame is
+ * drawn. The thread stops after it sends QUIT, which it does for 'q' and at
+ * the end of input
+ */
+class InputThread {
+public:
+	static constexpr std::size_t QUEUE_SIZE = 1024;
+
+	explicit InputThread(Backend &backend);
+	~InputThread();
+
+	/* blocks until there's a command waiting */
+	void wait();
+
+	/* takes the oldest command waiting, false if there isn't one */
+	bool pop(Command &c) { return this->queue.pop(c); }
+
+private:
+	Backend &backend;
+	SpscQueue<Command, QUEUE_SIZE> queue;
+
+	/*
+	 * only used to sleep while the queue is empty, the commands themselves
+	 * don't go through the lock
+	 */
+	std::mutex mutex;
+	std::condition_variable ready;
+
+	std::thread thread; /* started last, once everything it uses is */
+
+	void run();
+};
+}
+
+#endif /* INPUT_HH */
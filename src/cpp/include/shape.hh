@@ -3,42 +3,19 @@
 
 #include <fstream>
 #include <array>
-#include <unordered_map>
 
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
-#include <ncurses.h>
 
-#define SCALE 0.4
+#include "backend.hh"
+#include "command.hh"
+#include "framebuffer.hh"
+#include "viewport.hh"
 
-/*
- * Hash function for Eigen matrix and vector.
- * The code is from `hash_combine` function of the Boost library. See
- * http://www.boost.org/doc/libs/1_55_0/doc/html/hash/reference.html#boost.hash_combine .
- */
-template<typename T>
-struct matrix_hash : std::unary_function<T, size_t> {
-	std::size_t operator()(T const& matrix) const {
-		/*
-		 * Note that it is oblivious to the storage order of Eigen
-		 * matrix (column- or row-major). It will give you the same
-		 * hash value for two different matrices if they are the
-		 * transpose of each other in different storage order.
-		 */
-		size_t seed = 0;
-		for (ssize_t i = 0; i < matrix.size(); ++i) {
-			auto elem = *(matrix.data() + i);
-			seed ^= std::hash<typename T::Scalar>()(elem) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-		}
-
-		return seed;
-	}
-};
-
-enum t_pixel_print {
-	UPPER = '\'',
-	LOWER = ',',
-	FULL = ';'
+/* choose how edges are rasterized on to the screen */
+enum raster_method {
+	SAMPLE, /* e_density + 1 points per edge projected one at a time */
+	DDA     /* walk the projected edge cell by cell */
 };
 
 typedef std::array<Eigen::Vector3d*, 2> edge;
@@ -53,44 +30,68 @@ struct face {
 };
 
 namespace TS {
+/*
+ * places the shape in the world, as world = scale * rot * object + center.
+ * Transforms only change this, and the vertices, which stay as they were
+ * read, are placed from it once a frame
+ */
+struct Model {
+	Eigen::Quaterniond rot = Eigen::Quaterniond::Identity();
+	double scale = 1;
+	Eigen::Vector3d center = {0, 0, 0};
+};
+
 class Shape {
 public:
 	/* constructors */
 	Shape(std::string fname);
 	Shape(int argc, char **argv);
 
-	void set_win(WINDOW *win);
+	void set_backend(Backend *backend);
 	void toggle_print_vertices();
 	void toggle_print_edges();
 	void increase_e_density();
 	void decrease_e_density();
+	void toggle_raster();
 
 	void print();
-	void rotate(Eigen::Matrix3d rotation);
+	void print_text(int row, int col, const char *str);
+	const Framebuffer::stats &present_stats() const;
+	void rotate(const Eigen::AngleAxisd &rotation);
 	void scale(double scalar);
 	void translate(Eigen::Vector3d translation);
 
+	/* does what a command from the input thread asks */
+	void apply(const Command &c);
+
 private:
 	std::vector<Eigen::VectorXi> size; /* num vertices, edges, faces */
 	double e_density = 50.0;           /* number of points to draw along each edge */
 
-	Eigen::Vector3d center = {0, 0, 0}; /* center of the shape */
+	Model model; /* where the shape is, around its center */
 
-	std::vector<Eigen::Vector3d> vertices; /* vector of vertices */
+	std::vector<Eigen::Vector3d> vertices; /* vertices in object space */
 	std::vector<edge> edges;               /* vector of edges */
 	std::vector<face> faces;               /* vector of faces */
 
 	std::string fname;     /* file name of the shape coordinates */
-	WINDOW *win = nullptr; /* pointer to ncurses screen */
+	Backend *backend = nullptr; /* where frames are presented */
 
 	Eigen::Vector3d cop = {0, 0, 10000}; /* center of projection */
 
 	bool b_print_vertices = false; /* bool whether or not to print vertices */
 	bool b_print_edges = true;     /* bool whether or not to print edges */
 
-	/* maps for characters to print on the front and behind of the shape */
-	std::unordered_map<Eigen::Vector3d, t_pixel_print, matrix_hash<Eigen::Vector3d>> fronts;
-	std::unordered_map<Eigen::Vector3d, t_pixel_print, matrix_hash<Eigen::Vector3d>> behinds;
+	raster_method raster = SAMPLE; /* choose which raster method to use */
+
+	/* cells of the points to print, reused across frames */
+	Framebuffer fb;
+
+	/* projection for the current frame */
+	Viewport view;
+
+	/* vertices projected to (half cell x, half cell y, depth) every frame */
+	std::vector<Eigen::Vector3d> screen;
 
 	/* initialize the shape object from file */
 	void init(std::string fname);
@@ -99,12 +100,23 @@ private:
 	template <typename T>
 	std::vector<std::vector<T>> read_block(std::ifstream& f);
 
-	/* translate x, y coordinates to ncurses coordinate */
-	std::tuple<t_pixel_print, Eigen::Vector3d> movexy(Eigen::Vector3d);
+	/* place and project every vertex for the frame into screen */
+	void project_vertices();
+
+	/* projected position of a vertex an edge or face points to */
+	const Eigen::Vector3d &projected(const Eigen::Vector3d *v) const {
+		return this->screen[v - this->vertices.data()];
+	}
 
 	/* print vertices with their indices */
 	void print_vertices();
 
+	/* rasterize an edge by projecting e_density + 1 points along it */
+	void sample_edge(const edge &e);
+
+	/* rasterize an edge by walking its projection cell by cell */
+	void dda_edge(const edge &e);
+
 	/* print edges */
 	void print_edges();
 };
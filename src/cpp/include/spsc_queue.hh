@@ -0,0 +1,63 @@
+#ifndef SPSC_QUEUE_HH
+#define SPSC_QUEUE_HH
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace TS {
+/*
+ * fixed size queue between exactly one thread that pushes and one that pops,
+ * without locks. Each side only writes its own index, and publishes it with a
+ * release store the other side reads with an acquire load, so an item is
+ * fully written before the consumer can see it. The indices only ever grow
+ * and are wrapped into the ring when used, so a full queue and an empty one
+ * look different
+ */
+template <typename T, std::size_t N>
+class SpscQueue {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "size must be a power of two");
+
+public:
+	/* adds item to the back, false if the queue is full */
+	bool push(const T &item) {
+		std::size_t tail = this->tail.load(std::memory_order_relaxed);
+
+		if (tail - this->head.load(std::memory_order_acquire) == N) {
+			return false;
+		}
+
+		this->items[tail & (N - 1)] = item;
+		this->tail.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/* takes the item at the front into item, false if the queue is empty */
+	bool pop(T &item) {
+		std::size_t head = this->head.load(std::memory_order_relaxed);
+
+		if (head == this->tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = this->items[head & (N - 1)];
+		this->head.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	bool empty() const {
+		return this->head.load(std::memory_order_acquire) ==
+		       this->tail.load(std::memory_order_acquire);
+	}
+
+private:
+	/* on separate cache lines so the two threads don't keep taking them */
+	alignas(64) std::atomic<std::size_t> head{0}; /* written by the consumer */
+	alignas(64) std::atomic<std::size_t> tail{0}; /* written by the producer */
+	alignas(64) std::array<T, N> items;
+};
+}
+
+#endif /* SPSC_QUEUE_HH */
@@ -0,0 +1,49 @@
+#ifndef VIEWPORT_HH
+#define VIEWPORT_HH
+
+#include <Eigen/Dense>
+
+#define SCALE 0.4
+
+namespace TS {
+/*
+ * maps shape coordinates to fractional positions in the grid of half cells
+ * on the screen (one column wide and half a row high). It's computed once a
+ * frame from the size of the screen, with some magic numbers so an object
+ * described with a "radius" approximately 1 will be centered in the center of
+ * the screen and entirely fit on the screen
+ */
+struct Viewport {
+	int rows = 0; /* screen size in cells */
+	int cols = 0;
+
+	/* half cell = coordinate * scale + offset */
+	double scale_x = 0;
+	double scale_y = 0;
+	double off_x = 0;
+	double off_y = 0;
+
+	void update(int rows, int cols) {
+		this->rows = rows;
+		this->cols = cols;
+
+		this->scale_x = SCALE * rows;
+		this->off_x = 0.5 * cols;
+
+		/* y is reversed since rows count down the screen */
+		this->scale_y = -SCALE * rows;
+		this->off_y = rows;
+	}
+
+	/* position of v in the grid of half cells, keeping its depth */
+	Eigen::Vector3d project(const Eigen::Vector3d &v) const {
+		return {
+			v[0] * this->scale_x + this->off_x,
+			v[1] * this->scale_y + this->off_y,
+			v[2]
+		};
+	}
+};
+}
+
+#endif /* VIEWPORT_HH */
@@ -0,0 +1,176 @@
+#include "alloc_counter.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+ * replacements for the global allocation functions that count the bytes
+ * requested before handing off to malloc. Every form of new is replaced,
+ * including the aligned ones that over-aligned types like Eigen's fixed size
+ * vectorizable matrices go through, so nothing is allocated uncounted
+ */
+static std::atomic<std::size_t> alloc_bytes(0);
+
+/*
+ * counts and allocates size bytes aligned to align
+ *
+ * returns nullptr if the allocation failed
+ */
+static void *
+counted_alloc(std::size_t size, std::size_t align)
+{
+	alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (size == 0) {
+		size = 1;
+	}
+
+	if (align <= alignof(std::max_align_t)) {
+		return std::malloc(size);
+	}
+
+	/* aligned_alloc wants a size that's a multiple of the alignment */
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *
+operator new(std::size_t size)
+{
+	void *p = counted_alloc(size, alignof(std::max_align_t));
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void *
+operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void *
+operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void *
+operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void *
+operator new(std::size_t size, std::align_val_t align)
+{
+	void *p = counted_alloc(size, static_cast<std::size_t>(align));
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void *
+operator new[](std::size_t size, std::align_val_t align)
+{
+	return operator new(size, align);
+}
+
+void *
+operator new(std::size_t size, std::align_val_t align,
+	     const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void *
+operator new[](std::size_t size, std::align_val_t align,
+	       const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+/* aligned_alloc memory is released with free too, so every delete is free */
+void
+operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+namespace TS {
+std::size_t
+allocated_bytes()
+{
+	return alloc_bytes.load(std::memory_order_relaxed);
+}
+}
@@ -0,0 +1,374 @@
+#include "backend.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <ncurses.h>
+#include <term.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace TS {
+std::unique_ptr<Backend>
+Backend::create(const std::string &name, int rows, int cols)
+{
+	if (name == "ncurses") {
+		return std::make_unique<NcursesBackend>();
+	} else if (name == "memory") {
+		return std::make_unique<MemoryBackend>(rows, cols);
+	} else if (name == "text") {
+		return std::make_unique<TextBackend>(rows, cols);
+	}
+
+	return nullptr;
+}
+
+/*
+ * ncurses backend
+ */
+
+/* write end of the resize pipe of the backend, for the signal handler */
+static volatile sig_atomic_t resize_fd = -1;
+
+/*
+ * SIGWINCH can be delivered to any thread, so rather than count on it
+ * interrupting the read of the input thread, it wakes it through a pipe
+ */
+static void
+on_resize(int)
+{
+	int saved = errno;
+	char c = 0;
+
+	if (::write(resize_fd, &c, 1) < 0) {
+		/* the pipe is full, so a wake up is already waiting */
+	}
+
+	errno = saved;
+}
+
+/*
+ * keypad() isn't turned on, since keys are read straight from the terminal
+ * rather than with getch() (see read_key), so ncurses never decodes them.
+ * No command is on a function or arrow key, and their escape sequences are
+ * skipped whole
+ *
+ * the backend is made on the render thread, which is the one whose writes
+ * are counted
+ */
+NcursesBackend::NcursesBackend()
+{
+	this->io_fd = open("/proc/thread-self/io", O_RDONLY);
+	if (this->io_fd >= 0 && this->written() < 0) {
+		close(this->io_fd);
+		this->io_fd = -1;
+	}
+
+	/* start ncurses mode */
+	initscr();
+	noecho();
+	cbreak();
+	curs_set(0);
+
+	/* replaces the handler of ncurses, size() does what it did */
+	if (pipe(this->resize_pipe) == 0) {
+		fcntl(this->resize_pipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(this->resize_pipe[1], F_SETFL, O_NONBLOCK);
+		resize_fd = this->resize_pipe[1];
+
+		struct sigaction sa = {};
+		sa.sa_handler = on_resize;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGWINCH, &sa, nullptr);
+	}
+}
+
+NcursesBackend::~NcursesBackend()
+{
+	if (this->resize_pipe[0] >= 0) {
+		std::signal(SIGWINCH, SIG_DFL);
+		resize_fd = -1;
+
+		close(this->resize_pipe[0]);
+		close(this->resize_pipe[1]);
+	}
+
+	/* end ncurses mode */
+	endwin();
+
+	if (this->io_fd >= 0) {
+		close(this->io_fd);
+	}
+}
+
+/*
+ * getch() isn't called to notice the terminal was resized, so the size is
+ * checked here once a frame. After a resize the terminal may not show what
+ * ncurses thinks it does, so the whole screen is sent again
+ */
+void
+NcursesBackend::size(int &rows, int &cols)
+{
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 &&
+	    (ws.ws_row != LINES || ws.ws_col != COLS)) {
+		resizeterm(ws.ws_row, ws.ws_col);
+		clearok(curscr, TRUE);
+	}
+
+	getmaxyx(stdscr, rows, cols);
+}
+
+/*
+ * bytes the render thread has passed to write() so far. ncurses writes the
+ * screen to the terminal's file descriptor itself, so the bytes can't be
+ * counted on the way through a FILE handed to newterm(), but only the thread
+ * calling refresh() writes them
+ *
+ * returns the count, or -1 if it can't be read
+ */
+long
+NcursesBackend::written() const
+{
+	char buf[512];
+	ssize_t n = pread(this->io_fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0) {
+		return -1;
+	}
+
+	buf[n] = '\0';
+
+	const char *w = std::strstr(buf, "wchar:");
+	if (w == nullptr) {
+		return -1;
+	}
+
+	return std::strtol(w + std::strlen("wchar:"), nullptr, 10);
+}
+
+/*
+ * length of a terminfo string, used to estimate the bytes a put writes
+ */
+static long
+cap_len(const char *cap)
+{
+	if (cap == nullptr || cap == reinterpret_cast<char *>(-1)) {
+		return 0;
+	}
+
+	return std::strlen(cap);
+}
+
+long
+NcursesBackend::put(int row, int col, const char *str, int len)
+{
+	mvaddnstr(row, col, str, len);
+
+	if (!this->estimated()) {
+		return 0;
+	}
+
+	long bytes = len;
+	if (cursor_address != nullptr) {
+		bytes += cap_len(tiparm(cursor_address, row, col));
+	}
+
+	return bytes;
+}
+
+/*
+ * refreshes the screen, counting the bytes ncurses wrote to the terminal to
+ * do it
+ */
+long
+NcursesBackend::flush()
+{
+	if (this->estimated()) {
+		refresh();
+		return 0;
+	}
+
+	long before = this->written();
+	refresh();
+	long after = this->written();
+
+	return before >= 0 && after >= before ? after - before : 0;
+}
+
+/*
+ * next byte from the terminal, waiting at most timeout milliseconds for it
+ * (forever if it's negative)
+ *
+ * returns the byte, RESIZE if the screen changed size first, NO_BYTE if
+ * nothing came in time, or END if the terminal can't be read any more
+ */
+int
+NcursesBackend::read_byte(int timeout)
+{
+	struct pollfd fds[2] = {
+		{STDIN_FILENO, POLLIN, 0},
+		{this->resize_pipe[0], POLLIN, 0}
+	};
+
+	int n;
+	while ((n = poll(fds, this->resize_pipe[0] >= 0 ? 2 : 1, timeout)) < 0) {
+		if (errno != EINTR) {
+			return END;
+		}
+	}
+
+	if (n == 0) {
+		return NO_BYTE;
+	}
+
+	char drain[64];
+	if (fds[1].revents & POLLIN) {
+		while (::read(this->resize_pipe[0], drain, sizeof(drain)) > 0) {
+		}
+
+		return RESIZE;
+	}
+
+	unsigned char c;
+	if (::read(STDIN_FILENO, &c, 1) != 1) {
+		return END;
+	}
+
+	return c;
+}
+
+/*
+ * reads the terminal directly instead of with getch(), which would refresh the
+ * screen from the input thread while the render thread is drawing on it
+ *
+ * an escape sequence, like the ones function and arrow keys send, comes back
+ * as a single ESC, so its bytes aren't taken for keys. An ESC with nothing
+ * right after it is just the escape key
+ */
+int
+NcursesBackend::read_key()
+{
+	/* how long the rest of an escape sequence can take to come in */
+	const int escape_delay = 25;
+
+	int c = this->read_byte(-1);
+	if (c == 27) {
+		c = this->read_byte(escape_delay);
+
+		if (c == '[') {
+			/* parameters and intermediates, then a final byte */
+			do {
+				c = this->read_byte(escape_delay);
+			} while (c >= 0x20 && c <= 0x3f);
+		} else if (c == 'O') {
+			c = this->read_byte(escape_delay);
+		}
+
+		if (c != RESIZE && c != END) {
+			c = 27;
+		}
+	}
+
+	return c == END ? 'q' : c;
+}
+
+/*
+ * in-memory backend
+ */
+MemoryBackend::MemoryBackend(int rows, int cols)
+	: rows(rows), cols(cols),
+	  grid(static_cast<size_t>(rows) * cols, ' ')
+{
+}
+
+void
+MemoryBackend::size(int &rows, int &cols)
+{
+	rows = this->rows;
+	cols = this->cols;
+}
+
+/*
+ * copies the characters into the in-memory screen. The bytes counted are
+ * just the characters since there's no cursor movement
+ */
+long
+MemoryBackend::put(int row, int col, const char *str, int len)
+{
+	if (row < 0 || row >= this->rows || col >= this->cols) {
+		return 0;
+	}
+
+	if (col < 0) {
+		str -= col;
+		len += col;
+		col = 0;
+	}
+
+	if (col + len > this->cols) {
+		len = this->cols - col;
+	}
+
+	if (len <= 0) {
+		return 0;
+	}
+
+	std::memcpy(&this->grid[row * this->cols + col], str, len);
+
+	return len;
+}
+
+long
+MemoryBackend::flush()
+{
+	this->frame++;
+
+	return 0;
+}
+
+/*
+ * input for the headless backends is read from stdin, so a session can be
+ * scripted by piping keys in
+ */
+int
+MemoryBackend::read_key()
+{
+	int c = std::getchar();
+
+	return c == EOF ? 'q' : c;
+}
+
+/*
+ * dumps the in-memory screen to stdout with trailing blanks removed from each
+ * row, followed by a line separating it from the next frame
+ */
+long
+TextBackend::flush()
+{
+	for (int row = 0; row < this->rows; ++row) {
+		const char *line = &this->grid[row * this->cols];
+
+		int len = this->cols;
+		while (len > 0 && line[len - 1] == ' ') {
+			len--;
+		}
+
+		std::fwrite(line, 1, len, stdout);
+		std::putchar('\n');
+	}
+
+	std::printf("-- frame %d --\n", this->frame);
+	std::fflush(stdout);
+
+	this->frame++;
+
+	return 0;
+}
+}
@@ -0,0 +1,121 @@
+#include "command.hh"
+
+#include <cmath>
+
+#include "backend.hh"
+
+namespace TS {
+Command
+Command::from_key(int c)
+{
+	/* transformation variables */
+	const double theta = M_PI / 200;
+	const double dist = 0.1;
+	const double scale = 1.1;
+
+	Command cmd;
+
+	switch (c) {
+	/* quit */
+	case 'q':
+		cmd.type = QUIT;
+		break;
+
+	case Backend::RESIZE:
+		cmd.type = RESIZE;
+		break;
+
+
+	/* ** ROTATIONS ** */
+	/* rotate around z axis */
+	case 't':
+		cmd = {ROTATE, 2, theta};
+		break;
+	case 'y':
+		cmd = {ROTATE, 2, -theta};
+		break;
+
+	/* rotate around x axis */
+	case 'u':
+		cmd = {ROTATE, 0, theta};
+		break;
+	case 'i':
+		cmd = {ROTATE, 0, -theta};
+		break;
+
+	/* rotate around y axis */
+	case 'o':
+		cmd = {ROTATE, 1, theta};
+		break;
+	case 'p':
+		cmd = {ROTATE, 1, -theta};
+		break;
+
+	/* ** SCALE ** */
+	case '=':
+		cmd = {RESCALE, 0, scale};
+		break;
+
+	case '-':
+		cmd = {RESCALE, 0, 1.0 / scale};
+		break;
+
+
+	/* ** TRANSLATIONS ** */
+	/* translate along x axis */
+	case 'h':
+		cmd = {TRANSLATE, 0, -dist};
+		break;
+	case 'l':
+		cmd = {TRANSLATE, 0, dist};
+		break;
+
+	/* translate along y axis */
+	case 'j':
+		cmd = {TRANSLATE, 1, -dist};
+		break;
+	case 'k':
+		cmd = {TRANSLATE, 1, dist};
+		break;
+
+	/* translate along z axis */
+	case 'f':
+		cmd = {TRANSLATE, 2, -dist};
+		break;
+	case 'g':
+		cmd = {TRANSLATE, 2, dist};
+		break;
+
+
+	/* flip printing of vertices */
+	case '1':
+		cmd.type = TOGGLE_VERTICES;
+		break;
+
+	/* flip printing of edges */
+	case '2':
+		cmd.type = TOGGLE_EDGES;
+		break;
+
+
+	/* switch between raster methods */
+	case '4':
+		cmd.type = TOGGLE_RASTER;
+		break;
+
+
+	/* ** CHANGE EDGE DENSITY ** */
+	/* increase edge density */
+	case '0':
+		cmd.type = INCREASE_E_DENSITY;
+		break;
+
+	/* decrease edge density */
+	case '9':
+		cmd.type = DECREASE_E_DENSITY;
+		break;
+	}
+
+	return cmd;
+}
+}
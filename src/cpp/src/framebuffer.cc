@@ -0,0 +1,143 @@
+#include "framebuffer.hh"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace TS {
+/*
+ * size the grid to the screen. Nothing is known about what's on the screen
+ * after a change, so the next present redraws everything. assign() only
+ * reallocates when the grid grows past its capacity
+ */
+void
+Framebuffer::resize(int rows, int cols)
+{
+	rows = std::max(rows, 0);
+	cols = std::max(cols, 0);
+
+	if (rows == this->n_rows && cols == this->n_cols) {
+		return;
+	}
+
+	this->n_rows = rows;
+	this->n_cols = cols;
+
+	this->cells.assign(static_cast<size_t>(rows) * cols, 0);
+	this->prev.assign(static_cast<size_t>(rows) * cols, CELL_UNKNOWN);
+	this->line.assign(cols, ' ');
+}
+
+void
+Framebuffer::clear()
+{
+	std::fill(this->cells.begin(), this->cells.end(), 0);
+}
+
+/*
+ * forget what was presented, so every cell is redrawn by the next present
+ */
+void
+Framebuffer::invalidate()
+{
+	std::fill(this->prev.begin(), this->prev.end(), CELL_UNKNOWN);
+}
+
+/*
+ * writes the cells from col to end (inclusive) of a row and records them as
+ * presented
+ */
+void
+Framebuffer::present_span(Backend &backend, int row, int col, int end)
+{
+	this->present_stats.spans++;
+
+	for (int c = col; c <= end; ++c) {
+		uint8_t cell = this->at(row, c);
+		uint8_t &prev = this->prev[row * this->n_cols + c];
+
+		if (prev != cell) {
+			this->present_stats.cells++;
+		}
+
+		prev = cell;
+
+		this->line[c] = cell ? static_cast<char>(glyph(cell)) : ' ';
+	}
+
+	this->present_stats.bytes += backend.put(row, col, &this->line[col], end - col + 1);
+}
+
+/*
+ * changed cells on a row are grouped into spans, where a span continues over
+ * fewer than PRESENT_GAP unchanged cells since rewriting those is cheaper than
+ * moving the cursor past them
+ */
+void
+Framebuffer::present(Backend &backend)
+{
+	this->present_stats = {};
+
+	for (int row = 0; row < this->n_rows; ++row) {
+		const uint8_t *cur = &this->cells[row * this->n_cols];
+		const uint8_t *old = &this->prev[row * this->n_cols];
+
+		int col = 0;
+		while (col < this->n_cols) {
+			/* find the start of the next changed run */
+			if (cur[col] == old[col]) {
+				col++;
+				continue;
+			}
+
+			int start = col;
+			int end = col;
+			int gap = 0;
+
+			for (col = start + 1; col < this->n_cols; ++col) {
+				if (cur[col] != old[col]) {
+					end = col;
+					gap = 0;
+				} else if (++gap >= PRESENT_GAP) {
+					break;
+				}
+			}
+
+			this->present_span(backend, row, start, end);
+			col = end + 1;
+		}
+	}
+}
+
+/*
+ * the cells written over are marked as unknown, so the next present restores
+ * them
+ */
+void
+Framebuffer::text(Backend &backend, int row, int col, const char *str)
+{
+	int len = std::strlen(str);
+
+	this->present_stats.bytes += backend.put(row, col, str, len);
+
+	if (row < 0 || row >= this->n_rows) {
+		return;
+	}
+
+	for (int c = std::max(col, 0); c < std::min(col + len, this->n_cols); ++c) {
+		this->prev[row * this->n_cols + c] = CELL_UNKNOWN;
+	}
+}
+
+t_pixel_print
+Framebuffer::glyph(uint8_t bits)
+{
+	if ((bits & (CELL_UPPER | CELL_LOWER)) == (CELL_UPPER | CELL_LOWER)) {
+		return FULL;
+	} else if (bits & CELL_UPPER) {
+		return UPPER;
+	}
+
+	return LOWER;
+}
+}
@@ -0,0 +1,48 @@
+#include "input.hh"
+
+namespace TS {
+InputThread::InputThread(Backend &backend)
+	: backend(backend),
+	  thread(&InputThread::run, this)
+{
+}
+
+InputThread::~InputThread()
+{
+	this->thread.join();
+}
+
+void
+InputThread::wait()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	this->ready.wait(lock, [this] { return !this->queue.empty(); });
+}
+
+void
+InputThread::run()
+{
+	while (1) {
+		Command c = Command::from_key(this->backend.read_key());
+
+		/* the render thread is far behind, wait for it to catch up */
+		while (!this->queue.push(c)) {
+			std::this_thread::yield();
+		}
+
+		/*
+		 * taking the lock means the render thread is either waiting
+		 * already, or will see the command before it waits
+		 */
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+		}
+		this->ready.notify_one();
+
+		if (c.type == Command::QUIT) {
+			return;
+		}
+	}
+}
+}
@@ -16,165 +16,113 @@
  */
 
 #include <iostream>
-#include <vector>
-#include <chrono>
-#include <unordered_map>
+#include <cstdio>
 
-#include <Eigen/Dense>
-
-#include <ncurses.h>
+#include <unistd.h>
 
 #include "shape.hh"
+#include "input.hh"
+#include "alloc_counter.hh"
 
+/*
+ * render thread, which draws a frame, then waits for commands from the input
+ * thread. Every command that came in while the frame was drawn goes into the
+ * next frame, so a held key can't pile up frames behind the keyboard
+ *
+ * the bytes of a frame are only known once it's flushed, so the present stats
+ * shown are from the frame before
+ */
 void
-loop(TS::Shape &s)
+loop(TS::Shape &s, TS::Backend &backend)
 {
-	/* start ncurses mode */
-	initscr();
-	noecho();
-	cbreak();
-	keypad(stdscr, TRUE);
-	curs_set(0);
-
-	s.set_win(stdscr);
-
-	/* std::chrono::time_point<std::chrono::high_resolution_clock> op_start, op_end, p_start, p_end; */
+	s.set_backend(&backend);
 
-	/* transformation variables */
-	Eigen::Matrix3d rot;
-	double theta = M_PI / 200;
-	double dist = 0.1;
-	double scale = 1.1;
+	TS::InputThread input(backend);
+	int commands = 0;
+	TS::Framebuffer::stats last;
 
 	while (1) {
-		/* op_end = std::chrono::high_resolution_clock::now(); */
-		/* auto op_diff = std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count(); */
-
-		/* wclear(stdscr); */
-		/* mvwprintw(stdscr, 2, 1, "Operaton time: %05luµs", op_diff); */
-
-		/* p_start = std::chrono::high_resolution_clock::now(); */
+		size_t alloc_start = TS::allocated_bytes();
 		s.print();
-		/* p_end = std::chrono::high_resolution_clock::now(); */
-
-		/* auto p_diff = std::chrono::duration_cast<std::chrono::microseconds>(p_end - p_start).count(); */
-		/* mvwprintw(stdscr, 1, 1, "Print time: %05luµs", p_diff); */
-
-		/* wrefresh(stdscr); */
-
-		int c = getch();
-
-		/* op_start = std::chrono::high_resolution_clock::now(); */
+		size_t alloc_bytes = TS::allocated_bytes() - alloc_start;
 
-		switch(c) {
+		char hud[128];
+		std::snprintf(hud, sizeof(hud), "Frame allocations: %zu bytes", alloc_bytes);
+		s.print_text(1, 1, hud);
 
-		/* quit */
-		case 'q':
-			endwin();
-			return;
+		std::snprintf(hud, sizeof(hud), "Present: %d cells, %d spans, %ld bytes%s",
+			      last.cells, last.spans, last.bytes,
+			      backend.estimated() ? " (estimated)" : "");
+		s.print_text(2, 1, hud);
 
+		if (backend.interactive()) {
+			std::snprintf(hud, sizeof(hud), "Commands: %d this frame", commands);
+			s.print_text(3, 1, hud);
+		}
 
-		/* ** ROTATIONS ** */
-		/* rotate around z axis */
-		case 't':
-			rot = Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitZ());
-			s.rotate(rot);
-			break;
-		case 'y':
-			rot = Eigen::AngleAxisd(-theta, Eigen::Vector3d::UnitZ());
-			s.rotate(rot);
-			break;
-
-		/* rotate around z axis */
-		case 'u':
-			rot = Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitX());
-			s.rotate(rot);
-			break;
-		case 'i':
-			rot = Eigen::AngleAxisd(-theta, Eigen::Vector3d::UnitX());
-			s.rotate(rot);
-			break;
+		last = s.present_stats();
+		last.bytes += backend.flush();
 
-		/* rotate around y axis */
-		case 'o':
-			rot = Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitY());
-			s.rotate(rot);
-			break;
-		case 'p':
-			rot = Eigen::AngleAxisd(-theta, Eigen::Vector3d::UnitY());
-			s.rotate(rot);
-			break;
+		input.wait();
 
-		/* ** SCALE ** */
-		case '=':
-			s.scale(scale);
-			break;
+		TS::Command c;
+		commands = 0;
+		while (input.pop(c)) {
+			if (c.type == TS::Command::QUIT) {
+				return;
+			}
 
-		case '-':
-			s.scale(1.0 / scale);
-			break;
+			s.apply(c);
+			commands++;
 
+			if (!backend.interactive()) {
+				break;
+			}
+		}
+	}
+}
 
-		/* ** TRANSLATIONS ** */
-		/* translate along x axis */
-		case 'h':
-			s.translate({-dist, 0, 0});
-			break;
-		case 'l':
-			s.translate({dist, 0, 0});
-			break;
+int
+main(int argc, char **argv)
+{
+	std::string backend_name = "ncurses";
+	int rows = TS::Backend::DEFAULT_ROWS;
+	int cols = TS::Backend::DEFAULT_COLS;
 
-		/* translate along y axis */
-		case 'j':
-			s.translate({0, -dist, 0});
-			break;
-		case 'k':
-			s.translate({0, dist, 0});
+	int opt;
+	while ((opt = getopt(argc, argv, "b:g:")) != -1) {
+		switch (opt) {
+		/* backend to present frames with */
+		case 'b':
+			backend_name = optarg;
 			break;
 
-		/* translate along z axis */
-		case 'f':
-			s.translate({0, 0, -dist});
-			break;
+		/* screen size of the headless backends */
 		case 'g':
-			s.translate({0, 0, dist});
-			break;
-
-
-		/* flip printing of vertices */
-		case '1':
-			s.toggle_print_vertices();
-			break;
-
-		/* flip printing of edges */
-		case '2':
-			s.toggle_print_edges();
-			break;
-
-
-		/* ** CHANGE EDGE DENSITY ** */
-		/* increase edge density */
-		case '0':
-			s.increase_e_density();
-			break;
-
-		/* decrease edge density */
-		case '9':
-			s.decrease_e_density();
+			if (std::sscanf(optarg, "%dx%d", &cols, &rows) != 2 ||
+			    rows <= 0 || cols <= 0) {
+				std::cerr << "invalid size: " << optarg << std::endl;
+				return 1;
+			}
 			break;
 
 		default:
-			continue;
+			std::cerr << "usage: " << argv[0]
+				  << " [-b ncurses|memory|text] [-g COLSxROWS] [file]"
+				  << std::endl;
+			return 1;
 		}
 	}
-}
 
-int
-main(int argc, char **argv)
-{
+	auto s = TS::Shape(optind < argc ? argv[optind] : "./shapes/platonic_solids/cube.txt");
+
+	auto backend = TS::Backend::create(backend_name, rows, cols);
+	if (!backend) {
+		std::cerr << "unknown backend: " << backend_name << std::endl;
+		return 1;
+	}
 
-	auto s = TS::Shape(argc, argv);
-	loop(s);
+	loop(s, *backend);
 
 	return 0;
 }
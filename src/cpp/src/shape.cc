@@ -4,11 +4,14 @@
 #include <fstream>
 #include <sstream>
 #include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
 
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
 
-#include <ncurses.h>
 
 namespace TS {
 /*
@@ -29,9 +32,9 @@ Shape::Shape(std::string fname)
 }
 
 void
-Shape::set_win(WINDOW *win)
+Shape::set_backend(Backend *backend)
 {
-	this->win = win;
+	this->backend = backend;
 }
 
 void
@@ -60,50 +63,120 @@ Shape::decrease_e_density()
 	}
 }
 
+void
+Shape::toggle_raster()
+{
+	this->raster = (this->raster == SAMPLE) ? DDA : SAMPLE;
+}
+
+/*
+ * draws the frame into the framebuffer, and writes only the cells that
+ * changed since the last frame to the screen
+ */
 void
 Shape::print()
 {
-	wclear(this->win);
+	int winx, winy;
+	this->backend->size(winy, winx);
 
-	if (this->b_print_vertices) {
-		this->print_vertices();
-	}
+	this->fb.resize(winy, winx);
+	this->view.update(this->fb.rows(), this->fb.cols());
+	this->project_vertices();
+
+	this->fb.clear();
 
 	if (this->b_print_edges) {
 		this->print_edges();
 	}
 
-	wrefresh(this->win);
+	this->fb.present(*this->backend);
+
+	if (this->b_print_vertices) {
+		this->print_vertices();
+	}
+
 }
 
 void
-Shape::rotate(Eigen::Matrix3d rotation)
+Shape::print_text(int row, int col, const char *str)
 {
-	for (auto &v: this->vertices) {
-		v = (rotation * (v - this->center)) + this->center;
-	}
+	this->fb.text(*this->backend, row, col, str);
+}
 
-	for (auto &f: this->faces) {
-		f.calc_normal();
-	}
+const Framebuffer::stats &
+Shape::present_stats() const
+{
+	return this->fb.last_present();
+}
+
+/*
+ * turns the model, and the vertices follow when the frame is drawn. The
+ * rotation is normalized so the rounding of every turn doesn't add up
+ */
+void
+Shape::rotate(const Eigen::AngleAxisd &rotation)
+{
+	this->model.rot = rotation * this->model.rot;
+	this->model.rot.normalize();
 }
 
 void
 Shape::scale(double scalar)
 {
-	for (auto &v: this->vertices) {
-		v = ((v - this->center) * scalar) + this->center;
-	}
+	this->model.scale *= scalar;
 }
 
 void
 Shape::translate(Eigen::Vector3d translation)
 {
-	for (auto &v: this->vertices) {
-		v += translation;
-	}
+	this->model.center += translation;
+}
 
-	this->center += translation;
+void
+Shape::apply(const Command &c)
+{
+	switch (c.type) {
+	case Command::ROTATE:
+		this->rotate(Eigen::AngleAxisd(c.amount,
+					       Eigen::Vector3d::Unit(c.axis)));
+		break;
+
+	case Command::RESCALE:
+		this->scale(c.amount);
+		break;
+
+	case Command::TRANSLATE:
+		this->translate(c.amount * Eigen::Vector3d::Unit(c.axis));
+		break;
+
+	case Command::TOGGLE_VERTICES:
+		this->toggle_print_vertices();
+		break;
+
+	case Command::TOGGLE_EDGES:
+		this->toggle_print_edges();
+		break;
+
+	case Command::TOGGLE_RASTER:
+		this->toggle_raster();
+		break;
+
+	case Command::INCREASE_E_DENSITY:
+		this->increase_e_density();
+		break;
+
+	case Command::DECREASE_E_DENSITY:
+		this->decrease_e_density();
+		break;
+
+	case Command::RESIZE:
+		this->fb.invalidate();
+		break;
+
+	case Command::NONE:
+	case Command::QUIT:
+		break;
+	}
 }
 
 /*
@@ -191,88 +264,127 @@ Shape::read_block(std::ifstream& f)
 	return vec;
 }
 
-std::tuple<t_pixel_print, Eigen::Vector3d>
-Shape::movexy(Eigen::Vector3d v)
+/*
+ * places and projects every vertex once for the frame, so edges and labels
+ * read the same screen positions. The vertices are only read, so a frame is
+ * drawn from the model as it was when the frame started. The storage is kept
+ * between frames
+ */
+void
+Shape::project_vertices()
+{
+	const Eigen::Matrix3d m = this->model.scale *
+				  this->model.rot.toRotationMatrix();
+
+	this->screen.resize(this->vertices.size());
+
+	for (size_t i = 0; i < this->vertices.size(); ++i) {
+		this->screen[i] = this->view.project(m * this->vertices[i] +
+						     this->model.center);
+	}
+}
+
+void
+Shape::print_vertices()
 {
-	int winx, winy;
-	Eigen::Vector3d retv;
-	getmaxyx(this->win, winy, winx);
+	for (size_t i = 0; i < this->screen.size(); ++i) {
+		char label[32];
 
-	double fractionalx = ((v[0] * SCALE * winy) + (0.5 * winx));
-	double fractionaly = (-(v[1] * SCALE * .5 * winy) + (0.5 * winy));
+		int col = static_cast<int>(std::floor(this->screen[i][0]));
+		int row = static_cast<int>(std::floor(this->screen[i][1] / 2));
 
-	double integralx, integraly;
-	fractionalx = modf(fractionalx, &integralx);
-	fractionaly = modf(fractionaly, &integraly);
+		std::snprintf(label, sizeof(label), "%zu", i);
+		this->fb.text(*this->backend, row, col, label);
+	}
+}
 
-	retv[0] = integralx;
-	retv[1] = integraly;
+void
+Shape::sample_edge(const edge &e)
+{
+	/* the projection is affine, so points between project between these */
+	const Eigen::Vector3d &a = projected(e[0]);
+	Eigen::Vector3d v = projected(e[1]) - a;
+
+	/*
+	 * prints points along the edge
+	 *
+	 * e_density is a natural number directly corresponding to the number
+	 * of points printed along the edge
+	 */
+	for (auto k = 0; k <= this->e_density; ++k) {
+		Eigen::Vector3d w = a + (k / this->e_density) * v;
+
+		long x = static_cast<long>(std::floor(w[0]));
+		long y = static_cast<long>(std::floor(w[1]));
+
+		/* skip points that are off the screen */
+		if (x < 0 || x >= this->fb.cols() ||
+		    y < 0 || y >= 2L * this->fb.rows()) {
+			continue;
+		}
 
-	if (fractionaly >= 0.5) {
-		return std::make_tuple(LOWER, retv);
+		this->fb.at(y / 2, x) |= Framebuffer::bits((y & 1) ? LOWER : UPPER);
 	}
+}
 
-	return std::make_tuple(UPPER, retv);
+/*
+ * floor of a / b for b > 0, rounding towards negative infinity rather than
+ * towards zero like the / operator
+ */
+static long
+floor_div(long a, long b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
 }
 
+/*
+ * projects the two endpoints of the edge once and steps along the line in a
+ * grid of half cells (one column wide and half a row high), visiting each half
+ * cell on the line exactly once. The position at step i is the rounded value
+ * of start + i * delta / n, computed with integers
+ */
 void
-Shape::print_vertices()
+Shape::dda_edge(const edge &e)
 {
-	size_t idx = 0;
-	for (auto v: this->vertices) {
-		Eigen::Vector3d u;
+	const Eigen::Vector3d &a = projected(e[0]);
+	const Eigen::Vector3d &b = projected(e[1]);
+
+	long x0 = static_cast<long>(std::floor(a[0]));
+	long y0 = static_cast<long>(std::floor(a[1]));
+	long dx = static_cast<long>(std::floor(b[0])) - x0;
+	long dy = static_cast<long>(std::floor(b[1])) - y0;
+	long n = std::max(std::labs(dx), std::labs(dy));
+
+	for (long i = 0; i <= n; ++i) {
+		long x = x0, y = y0;
+		if (n > 0) {
+			x += floor_div(2 * i * dx + n, 2 * n);
+			y += floor_div(2 * i * dy + n, 2 * n);
+		}
 
-		std::tie(std::ignore, u) = movexy(v);
-		mvwprintw(this->win, u[1], u[0], "%zu", idx);
+		if (x < 0 || x >= this->fb.cols() ||
+		    y < 0 || y >= 2L * this->fb.rows()) {
+			continue;
+		}
 
-		idx++;
+		this->fb.at(y / 2, x) |= Framebuffer::bits((y & 1) ? LOWER : UPPER);
 	}
 }
 
 void
 Shape::print_edges()
 {
-	int winx, winy;
-	getmaxyx(this->win, winy, winx);
-
-	this->fronts.clear();
-
 	/* iterate over the edges */
-	for (auto e: this->edges) {
-		Eigen::Vector3d v = *e[1] - *e[0];
-		double v_len = v.norm();
-		Eigen::Vector3d u = v.normalized();
-
-		/*
-		 * prints points along the edge
-		 *
-		 * e_density is a natural number directly corresponding to the
-		 * number of points printed along the edge
-		 */
-		for (auto k = 0; k <= this->e_density; ++k) {
-			Eigen::Vector3d w = *e[0] + ((k / this->e_density) * v_len) * u;
-
-			auto [tpp, p] = movexy(w);
-
-			/* skip points that are off the screen */
-			if (p[0] < 0 || p[0] > winx ||
-			    p[1] < 0 || p[1] > winy) {
-				continue;
-			}
-
-			/* TODO: clean this up */
-			if (this->fronts.count(p)) {
-				if (this->fronts[p] != tpp) {
-					this->fronts[p] = FULL;
-				}
-			} else {
-				this->fronts[p] = tpp;
-			}
-		}
-	}
+	for (const auto &e: this->edges) {
+		switch (this->raster) {
+		case SAMPLE:
+			this->sample_edge(e);
+			break;
 
-	for (auto val: this->fronts) {
-		mvwprintw(this->win, val.first[1], val.first[0], "%c", val.second);
+		case DDA:
+			this->dda_edge(e);
+			break;
+		}
 	}
 }
 }
@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# usage: check.sh BINARY [update]
+#
+# runs a scripted session of keys on every shape below through the text
+# backend, and compares the frames with the ones in tests/golden. With
+# "update", the golden frames are written instead
+#
+# the keys go through every occlusion type with a couple of turns in each, for
+# the sample and dda raster methods, then in braille with dda, then with filled
+# faces. The frames don't depend on the number of threads the edges are drawn on, so
+# each shape is checked on one thread and on several against the same frames
+
+bin=$1
+dir=$(dirname "$0")
+keys='3uo3uo3uo3uo3uo3uo43uo3uo3uo3uo3uo3uo53uo3uo3uo3uo3uo3uo56uo'
+size=80x30
+threads='1 4'
+
+# the star has faces that aren't convex, and isn't convex itself
+shapes='
+platonic_solids/icosahedron
+archimedean_solids/truncated_octahedron
+kepler_poinsot_polyhedra/small_stellated_dodecahedron
+miscellaneous/S
+'
+
+if [ -z "$bin" ]; then
+	echo "usage: $0 BINARY [update]" >&2
+	exit 2
+fi
+
+failed=0
+out=$(mktemp)
+trap 'rm -f "$out"' EXIT
+
+for shape in $shapes; do
+	name=$(basename "$shape")
+	golden="$dir/golden/$name.txt"
+
+	if [ "$2" = update ]; then
+		printf '%s' "$keys" | "$bin" -q -b text -g $size \
+			"$dir/../shapes/$shape.txt" > "$golden"
+		echo "updated $golden"
+		continue
+	fi
+
+	for j in $threads; do
+		printf '%s' "$keys" | "$bin" -q -j $j -b text -g $size \
+			"$dir/../shapes/$shape.txt" > "$out"
+
+		if cmp -s "$golden" "$out"; then
+			echo "ok   $name -j $j"
+		else
+			echo "FAIL $name -j $j"
+			diff "$golden" "$out" | head -20
+			failed=1
+		fi
+	done
+done
+
+exit $failed